@@ -7,263 +7,602 @@
  *
  *******************************************************************************/
 #include"../imp_files/std_types.h"
+#include"../imp_files/common_macros.h"
 #include"../HAL_Drivers/LCD.h"
 #include"../HAL_Drivers/keypad.h"
+#include"../HAL_Drivers/Protocol.h"
 #include"../MCAL_Drivers/UART.h"
 #include"../MCAL_Drivers/Timer.h"
-#include"util/delay.h"
+#include"../MCAL_Drivers/Power.h"
 #include"main.h"
+#include <avr/pgmspace.h>
 
-/*Timer configuration for Timer1 in CTC mode
- ** F_CPU = 8MHz, prescaler = 256
- ** For a timer to generate an interrupt every second:
- ** OCR1A=1s/(256/8000000)=31250;
- ** Therefore, we set OCR1A to 31250
- */
-Timer_ConfigType Timer_config = { 0, 31250, TIMER1_ID, CLK_OVER_256, CTC_1 };
+#if !UART_BAUD_OK(HMI_BAUD_RATE)
+#error "HMI_BAUD_RATE is more than 2% off at this F_CPU"
+#endif
 
 // Counters for failed password attempts
 uint8 num_of_fault_in_pass_when_open_door = 0;
 uint8 num_of_fault_in_pass_when_change_pass = 0;
 
-int main(void) {
-	// Enable global interrupts
-	SREG_REG.Bits.I_Bit = LOGIC_HIGH;
+// Password and its confirmation, sent as one request payload
+uint8 passwords[2 * PASS_SIZE];
+
+// Password being typed (points into passwords) and number of typed digits
+uint8 *entered_pass = passwords;
+uint8 num_of_digits = 0;
+
+// Operation chosen in the main menu (OPEN_DOOR or CHANGE_PASS)
+uint8 operation = OPEN_DOOR;
+
+// Request waiting for its response: sequence number, content kept to send it again
+uint8 request_sequence = 0;
+uint8 request_command = 0;
+const uint8 *request_payload = NULL_PTR;
+uint8 request_length = 0;
+uint8 request_retries = 0;
+
+// Link baud rate: index in link_bauds in use, highest index left to negotiate,
+// negotiation step and its pending SET_BAUD request, and fallback asked for by
+// a request that got no answer
+uint8 baud_index = 0;
+uint8 baud_max = 0;
+App_BaudStateType baud_state = BAUD_IDLE;
+uint8 baud_request = 0;
+uint8 baud_sequence = 0;
+uint8 baud_retries = 0;
+boolean baud_fallback = FALSE;
+
+// Requests sent again after no response, for LINK_STATS (saturates at 0xFFFF)
+uint16 retransmits = 0;
+
+// Worst-case time spent handling one event, in microseconds
+uint32 dispatch_max_us = 0;
+
+// Current state, last pressed key and last received frame
+App_StateType state = STATE_ENTER_PASS;
+uint8 pressed_key = 0;
+Protocol_FrameType frame;
+
+// LCD texts, kept in flash and streamed to the LCD without a copy in SRAM
+static const char messages[NUM_OF_MESSAGES][LCD_NUM_COLS + 1] PROGMEM = {
+	[MSG_ENTER_PASS]       = "plz enter pass: ",
+	[MSG_REENTER_PASS]     = "plz re-enter the",
+	[MSG_SAME_PASS]        = "same pass: ",
+	[MSG_MENU_OPEN_DOOR]   = "+ : Open Door",
+	[MSG_MENU_CHANGE_PASS] = "- : Change Pass",
+	[MSG_ENTER_DOOR_PASS]  = "enter door pass:",
+	[MSG_SYSTEM_LOCKED]    = "System locked",
+	[MSG_WAIT_1_MIN]       = "wait for 1 min",
+	[MSG_DOOR_UNLOCKING]   = "Door Unlocking",
+	[MSG_PLEASE_WAIT]      = "please wait..",
+	[MSG_WAIT_FOR_PEOPLE]  = "wait for people",
+	[MSG_TO_ENTER]         = "to enter",
+	[MSG_DOOR_LOCKING]     = "Door locking",
+	[MSG_NO_REPLY]         = "No reply from",
+	[MSG_CONTROL_ECU]      = "Control ECU",
+};
+
+// Link baud rates by SET_BAUD index, same table on the Control side
+#define LINK_BAUD(rate) { UART_BAUD_SETTING(rate), UART_BAUD_OK(rate) }
+
+static const App_BaudType link_bauds[NUM_OF_BAUDS] = {
+	LINK_BAUD(HMI_BAUD_RATE), LINK_BAUD(19200), LINK_BAUD(38400),
+	LINK_BAUD(57600), LINK_BAUD(115200)
+};
+
+/*******************************************************************************
+ *                      Screens and helpers                                    *
+ *******************************************************************************/
 
-	// Initialize LCD
-	LCD_init();
+// Screen timer callback, deferred by the Timer driver so it runs in the main loop
+static void timer_callBack(void) {
+	App_dispatch(EVENT_TIMEOUT);
+}
 
-	// UART configuration and initialization
-	UART_ConfigType config = { EIGHT_BITS, DISABLED, one_bit, 9600 };
-	UART_init(&config);
+// Show one of the flash texts at the given position
+static void show_message(uint8 row, uint8 col, App_MessageType message) {
+	LCD_displayStringRowColumn_P(row, col, messages[message]);
+}
+
+// Start a timed screen of the given number of seconds
+static void start_timer(uint8 seconds) {
+	Timer_softStart(SCREEN_TIMER_ID, (uint16) seconds * 1000, TIMER_ONE_SHOT,
+			timer_callBack);
+}
 
-	// Start the first step of the process
-	step1();
+// Send the pending request and wait RESPONSE_TIMEOUT_MS for its response
+static void transmit_request(void) {
+	request_sequence = PROTOCOL_sendFrame(request_command, request_payload,
+			request_length);
+	Timer_softStart(SCREEN_TIMER_ID, RESPONSE_TIMEOUT_MS, TIMER_ONE_SHOT,
+			timer_callBack);
+}
 
-	for (;;) {
+// Send a request, it is sent again if no response comes in time
+static void send_request(uint8 command, const uint8 *payload, uint8 length) {
+	request_command = command;
+	request_payload = payload;
+	request_length = length;
+	request_retries = 0;
+	transmit_request();
+}
 
+// Check if the received frame is the response to the pending request, with its
+// one result byte (stops the response timeout if it is)
+static boolean is_response(uint8 command) {
+	if ((frame.command != command) || (frame.sequence != request_sequence)
+			|| (frame.length != 1)) {
+		return FALSE;
 	}
+	Timer_softStop(SCREEN_TIMER_ID);
+	return TRUE;
 }
 
-// Function to display alarm message
-void Alarm_message() {
-	LCD_clearScreen();
-	LCD_displayStringRowColumn(0, 1, "System locked");
-	LCD_displayStringRowColumn(1, 0, "wait for 1 min");
+// Switch the UART to a rate of link_bauds. Queued bytes Control doesn't take
+// in time (CTS held high) are dropped, and the link goes back to HMI_BAUD_RATE
+static void set_baud(uint8 index) {
+	baud_index = index;
+	if (UART_setBaud(link_bauds[index].setting, BAUD_SWITCH_TIMEOUT_MS) != UART_OK) {
+		baud_index = 0;
+		UART_setBaud(link_bauds[0].setting, BAUD_SWITCH_TIMEOUT_MS);
+	}
 }
 
-// Function to handle password change
-void pass_change() {
-	UART_sendByte(HMI_ready);
-	while (UART_recieveByte() != CONTROL_ready)
-		; // Wait for control acknowledgment
+static void baud_timer_callBack(void);
 
-	uint8 is_match = UART_recieveByte(); // Receive match status
-	if (is_match) {
-		num_of_fault_in_pass_when_change_pass = 0; // Reset fault counter
-		LCD_clearScreen();
-		step1(); // Proceed to step 1
-	} else {
-		num_of_fault_in_pass_when_change_pass++;
-		if (num_of_fault_in_pass_when_change_pass < 3) {
-			LCD_clearScreen();
-			step3(); // Prompt for password again
-			pass_change(); // Retry password change
-		} else {
-			num_of_fault_in_pass_when_change_pass = 0;
-			UART_sendByte(Alarm); // Trigger alarm
-			Alarm_message(); // Show alarm message
-			g_total_ticks = 60; /* Set timer duration to call call-
-			 back function after 60s(interrupt after 1s)*/
-			Timer_init(&Timer_config); // Initialize timer
-			Timer_setCallBack(step2, TIMER1_ID); // Set callback for step2
+// Send the pending SET_BAUD request and wait RESPONSE_TIMEOUT_MS for its response
+static void transmit_baud_request(void) {
+	baud_sequence = PROTOCOL_sendFrame(SET_BAUD, &baud_request, 1);
+	Timer_softStart(BAUD_TIMER_ID, RESPONSE_TIMEOUT_MS, TIMER_ONE_SHOT,
+			baud_timer_callBack);
+}
 
-		}
+// Send a SET_BAUD request for the given step, it is sent again if no response comes in time
+static void send_baud_request(App_BaudStateType step, uint8 index) {
+	baud_state = step;
+	baud_request = index;
+	baud_retries = 0;
+	transmit_baud_request();
+}
+
+/*
+ * Start agreeing with Control on the highest rate of link_bauds both support,
+ * up to baud_max. The offer goes at HMI_BAUD_RATE, and the agreed rate is
+ * checked with a second request at that rate: without an answer, both go back
+ * to HMI_BAUD_RATE (Control on the line errors) and the next lower rate is
+ * tried. A Control that doesn't know SET_BAUD keeps the link at HMI_BAUD_RATE.
+ * Runs beside the screens, on its own timer: keys and requests go on meanwhile.
+ * Not on a multi-drop bus (HMI_NODE_ADDRESS): the Control UART is shared by
+ * all the panels, one of them can't move it away from the others.
+ */
+static void negotiate_baud(void) {
+	Timer_softStop(BAUD_TIMER_ID);
+	set_baud(0);
+	if (baud_max == 0) {
+		baud_state = BAUD_IDLE;
+		return;
 	}
+	send_baud_request(BAUD_WAIT_OFFER, baud_max);
 }
 
-// Function to display Door Unlocking if passwords matched
-void Door_unlocking() {
-	UART_sendByte(HMI_ready);
-	while (UART_recieveByte() != CONTROL_ready)
-		; // Wait for control acknowledgment
+// Control answered the pending SET_BAUD request
+static void on_baud_response(void) {
+	uint8 index;
 
-	uint8 is_match = UART_recieveByte(); // Receive match status
-	if (is_match) {
-		num_of_fault_in_pass_when_open_door = 0; // Reset fault counter
-		UART_sendByte(OPEN_DOOR); // Send open door command
-		LCD_clearScreen();
-		LCD_displayStringRowColumn(0, 0, "Door Unlocking");
-		LCD_displayStringRowColumn(1, 3, "please wait..");
-		g_total_ticks = 15; /*Set timer duration to call call-
-		 back function after 15s(interrupt after 1s)*/
-		Timer_init(&Timer_config); // Initialize timer
-		Timer_setCallBack(display_wait, TIMER1_ID); // Set display wait callback
+	if ((baud_state == BAUD_IDLE) || (frame.sequence != baud_sequence)
+			|| (frame.length != 1)) {
+		return;
+	}
+	index = frame.payload[0];
+	Timer_softStop(BAUD_TIMER_ID);
+	if ((baud_state == BAUD_WAIT_OFFER) && (index != 0) && (index <= baud_max)) {
+		set_baud(index); // Control switched after its response
+		send_baud_request(BAUD_WAIT_CHECK, index);
+	} else {
+		baud_state = BAUD_IDLE; // The link works at this rate
+	}
+}
 
+// No SET_BAUD response in time: send it again, or give up on this rate
+static void baud_timer_callBack(void) {
+	if (baud_retries < REQUEST_RETRIES) {
+		baud_retries++;
+		COUNT_SATURATED(retransmits);
+		transmit_baud_request();
+	} else if (baud_state == BAUD_WAIT_CHECK) {
+		baud_max = baud_request - 1;
+		negotiate_baud();
 	} else {
-		num_of_fault_in_pass_when_open_door++;
-		if (num_of_fault_in_pass_when_open_door < 3) {
-			LCD_clearScreen();
-			step3(); // Prompt for password again
-			Door_unlocking(); // Retry door unlocking
-		} else {
-			num_of_fault_in_pass_when_open_door = 0;
-			UART_sendByte(Alarm); // Trigger alarm
-			Alarm_message(); // Show alarm message
-			g_total_ticks = 60; /*Set timer duration to call call-
-			 back function after 60s(interrupt after 1s)*/
-			Timer_init(&Timer_config); // Initialize timer
-			Timer_setCallBack(step2, TIMER1_ID); // Set callback for step2
+		baud_state = BAUD_IDLE; // Stay at HMI_BAUD_RATE
+	}
+}
 
-		}
+// Too many line errors, or no answer at a negotiated rate: use a lower one
+static void fall_back_baud(void) {
+	if (baud_index > 0) {
+		baud_max = baud_index - 1;
+		negotiate_baud();
+	}
+	baud_fallback = FALSE;
+	UART_clearLineErrors();
+}
+
+// Answer a LINK_STATS request with the link counters, and clear them if asked to
+static void send_link_stats(void) {
+	UART_StatsType uart;
+	Protocol_StatsType protocol;
+	uint16 stats[NUM_OF_STATS];
+	uint8 payload[2 * NUM_OF_STATS];
+	uint8 i;
+
+	UART_getStats(&uart);
+	PROTOCOL_getStats(&protocol);
+	stats[STAT_FRAMES_RECEIVED] = protocol.frames_received;
+	stats[STAT_BYTES_RECEIVED] = uart.bytes_received;
+	stats[STAT_OVERRUNS] = uart.overruns;
+	stats[STAT_FRAME_ERRORS] = uart.frame_errors;
+	stats[STAT_PARITY_ERRORS] = uart.parity_errors;
+	stats[STAT_CRC_ERRORS] = protocol.crc_errors;
+	stats[STAT_RETRANSMITS] = retransmits;
+	stats[STAT_RX_OVERFLOWS] = uart.rx_overflows;
+	stats[STAT_FRAMES_SENT] = protocol.frames_sent;
+	stats[STAT_CUT_FRAMES] = protocol.cut_frames;
+	for (i = 0; i < NUM_OF_STATS; i++) {
+		payload[2 * i] = (uint8) stats[i];
+		payload[2 * i + 1] = (uint8) (stats[i] >> 8);
+	}
+	PROTOCOL_sendResponse(&frame, payload, sizeof(payload));
+
+	if ((frame.length == 1) && (frame.payload[0] != 0)) {
+		UART_clearStats();
+		PROTOCOL_clearStats();
+		retransmits = 0;
 	}
 }
 
-// Function to handle the first step of password creating
-void step1(void) {
-	uint8 real_password[PASS_SIZE], counter = 0, confirmed_password[PASS_SIZE];
-	LCD_displayStringRowColumn(0, 0, "plz enter pass: ");
+// Start typing a new password into the given buffer
+static void start_password(uint8 *buffer) {
+	entered_pass = buffer;
+	num_of_digits = 0;
+}
+
+// Screen of the first step of password creating
+static App_StateType show_enter_pass(void) {
+	LCD_clearScreen();
+	show_message(0, 0, MSG_ENTER_PASS);
 	LCD_moveCursor(1, 0);
+	start_password(passwords);
+	return STATE_ENTER_PASS;
+}
 
-	// Get real password from user input
-	for (counter = 0; counter < PASS_SIZE; counter++) {
-		uint8 read = KEYPAD_getPressedKey();
+// Screen of step 2, main options
+static App_StateType show_main_menu(void) {
+	Timer_softStop(SCREEN_TIMER_ID); // Stop the screen timer
+	LCD_clearScreen();
+	show_message(0, 0, MSG_MENU_OPEN_DOOR);
+	show_message(1, 0, MSG_MENU_CHANGE_PASS);
+	return STATE_MAIN_MENU;
+}
 
-		if (read >= 0 && read <= 9) { // Check if the key is a valid digit
-			real_password[counter] = read;
-			// store read in password
-			_delay_ms(300); //Small delay for stability
-			LCD_displayCharacter('*'); // Display asterisk for security
-		} else {
-			counter--; // Decrement counter if invalid key is pressed
-		}
+// Screen of step 3, password entry for the chosen operation
+static App_StateType show_check_pass(void) {
+	LCD_clearScreen();
+	show_message(0, 0, MSG_ENTER_DOOR_PASS);
+	LCD_moveCursor(1, 0);
+	start_password(passwords);
+	return STATE_CHECK_PASS;
+}
+
+// Alarm screen, locks the system for 1 min
+static App_StateType show_alarm(void) {
+	PROTOCOL_sendFrame(Alarm, NULL_PTR, 0); // Trigger alarm
+	LCD_clearScreen();
+	show_message(0, 1, MSG_SYSTEM_LOCKED);
+	show_message(1, 0, MSG_WAIT_1_MIN);
+	start_timer(SYSTEM_LOCKED_TIME);
+	return STATE_SYSTEM_LOCKED;
+}
+
+/*******************************************************************************
+ *                      Transition actions                                     *
+ *******************************************************************************/
+
+// Digit typed while entering a password
+static App_StateType on_digit(void) {
+	if (num_of_digits < PASS_SIZE) {
+		entered_pass[num_of_digits] = pressed_key; // store read in password
+		num_of_digits++;
+		LCD_displayCharacter('*'); // Display asterisk for security
 	}
+	return state;
+}
 
-	while (KEYPAD_getPressedKey() != Enter)
-		; // Wait for Enter key
-	_delay_ms(200); //Small delay for stability
+// Enter pressed after the new password, ask for it again
+static App_StateType on_pass_entered(void) {
+	if (num_of_digits < PASS_SIZE) {
+		return state; // Password not complete yet
+	}
 	LCD_clearScreen();
-	LCD_displayStringRowColumn(0, 0, "plz re-enter the");
-	LCD_displayStringRowColumn(1, 0, "same pass: ");
-
-	// Get confirmed password from user input
-	for (counter = 0; counter < PASS_SIZE; counter++) {
-		uint8 read = KEYPAD_getPressedKey();
-
-		if (read >= 0 && read <= 9) { //Check if the key is a valid digit
-			confirmed_password[counter] = read;
-			// store read in confirmed password
-			_delay_ms(300); //Small delay for stability
-			LCD_displayCharacter('*'); // Display asterisk for security
-		} else {
-			counter--; // Decrement counter if invalid key is pressed
-		}
+	show_message(0, 0, MSG_REENTER_PASS);
+	show_message(1, 0, MSG_SAME_PASS);
+	start_password(passwords + PASS_SIZE);
+	return STATE_CONFIRM_PASS;
+}
+
+// Enter pressed after the confirmation, send both passwords in one request
+static App_StateType on_confirm_entered(void) {
+	if (num_of_digits < PASS_SIZE) {
+		return state; // Password not complete yet
 	}
+	send_request(SAVE_PASS_and_confirm, passwords, 2 * PASS_SIZE);
+	return STATE_WAIT_SAVE_RESULT;
+}
 
-	while (KEYPAD_getPressedKey() != Enter)
-		; // Wait for Enter key
-	_delay_ms(200);
-
-	// Send password confirmation request
-	UART_sendByte(SAVE_PASS_and_confirm);
-	UART_sendByte(HMI_ready);
-	while (UART_recieveByte() != CONTROL_ready)
-		; // Wait for control acknowledgment
-
-	// Send both passwords
-	UART_sendString(real_password);
-	UART_sendByte('#');
-	UART_sendString(confirmed_password);
-	UART_sendByte('#');
-
-	UART_sendByte(HMI_ready);
-	while (UART_recieveByte() != CONTROL_ready)
-		; // Wait for control acknowledgment
-	uint8 result = UART_recieveByte(); // Get match result
-	if (result == matched) {
-		LCD_clearScreen();
-		step2(); // Proceed to step 2
-	} else {
-		LCD_clearScreen();
-		step1(); // Retry password input
+// Control compared both passwords
+static App_StateType on_save_result(void) {
+	if (!is_response(SAVE_PASS_and_confirm)) {
+		return state;
+	}
+	if (frame.payload[0] == matched) {
+		return show_main_menu(); // Proceed to step 2
 	}
+	return show_enter_pass(); // Retry password input
+}
+
+// '+' chosen in the main menu
+static App_StateType on_open_door(void) {
+	operation = OPEN_DOOR;
+	return show_check_pass();
+}
+
+// '-' chosen in the main menu
+static App_StateType on_change_pass(void) {
+	operation = CHANGE_PASS;
+	return show_check_pass();
+}
+
+// Enter pressed after the password, Control checks it and runs the operation
+static App_StateType on_check_entered(void) {
+	if (num_of_digits < PASS_SIZE) {
+		return state; // Password not complete yet
+	}
+	send_request(operation, passwords, PASS_SIZE);
+	return STATE_WAIT_CHECK_RESULT;
 }
-// Function to handle step 2 of the system and show main options
-void step2() {
-	LCD_clearScreen();
-	LCD_displayStringRowColumn(0, 0, "+ : Open Door");
-	LCD_displayStringRowColumn(1, 0, "- : Change Pass");
-	Timer_deInit(TIMER1_ID); // Deinitialize timer
 
-	// Check user input for actions
-	uint8 read = KEYPAD_getPressedKey();
+// Control checked the password
+static App_StateType on_check_result(void) {
+	uint8 *faults = (operation == OPEN_DOOR) ?
+			&num_of_fault_in_pass_when_open_door :
+			&num_of_fault_in_pass_when_change_pass;
 
-	while (read != '+' && read != '-') {
-		read = KEYPAD_getPressedKey();
+	if (!is_response(operation)) {
+		return state;
+	}
+	if (frame.payload[0] == matched) {
+		*faults = 0; // Reset fault counter
+		if (operation == CHANGE_PASS) {
+			return show_enter_pass(); // Proceed to step 1
+		}
+		LCD_clearScreen();
+		show_message(0, 0, MSG_DOOR_UNLOCKING);
+		show_message(1, 3, MSG_PLEASE_WAIT);
+		start_timer(DOOR_UNLOCKING_TIME);
+		return STATE_DOOR_UNLOCKING;
 	}
-	if (read == '+') {
-		_delay_ms(300);
-		step3(); // Prompt for password to open door
-		Door_unlocking(); // Attempt to unlock door
-		;
-	} else if (read == '-') {
-		_delay_ms(300);
-		step3(); // Prompt for password to change
-		pass_change(); // Attempt to change password
 
+	(*faults)++;
+	if (*faults < MAX_PASS_FAULTS) {
+		return show_check_pass(); // Prompt for password again
 	}
+	*faults = 0;
+	return show_alarm();
 }
 
-// Function to handle waiting during door unlocking
-void display_wait() {
+// Door is open, ask Control if people are passing
+static App_StateType on_unlocking_done(void) {
+	Timer_softStop(SCREEN_TIMER_ID); // Stop the screen timer
 	LCD_clearScreen();
-	UART_sendByte(HMI_ready);
-	if (UART_recieveByte() == people_detected) {
-		LCD_displayStringRowColumn(0, 0, "wait for people");
-		LCD_displayStringRowColumn(1, 2, "to enter");
-		Timer_deInit(TIMER1_ID); // Deinitialize timer
-
-		// Wait for people to exit detection
-		while (UART_recieveByte() != people_notdetected)
-			;
-		LCD_clearScreen();
-		LCD_displayStringRowColumn(0, 2, "Door locking");
-		g_total_ticks = 15; /*Set timer duration to call call-
-		 back function after 15s(interrupt after 1s)*/
-		Timer_init(&Timer_config); // Initialize timer
-		Timer_setCallBack(step2, TIMER1_ID); // Set callback for step 2
+	send_request(MOTION_STATUS, NULL_PTR, 0);
+	return STATE_WAIT_MOTION_STATUS;
+}
 
+// Control sent the people sensor status
+static App_StateType on_motion_status(void) {
+	if (!is_response(MOTION_STATUS)) {
+		return state;
+	}
+	if (frame.payload[0] == people_detected) {
+		show_message(0, 0, MSG_WAIT_FOR_PEOPLE);
+		show_message(1, 2, MSG_TO_ENTER);
+		start_timer(PEOPLE_TIMEOUT_TIME); // Ask again if the report gets lost
+		return STATE_WAIT_PEOPLE;
 	}
+	start_timer(DOOR_UNLOCKING_TIME); // Ask again later
+	return STATE_DOOR_UNLOCKING;
 }
 
-// Function to handle password entry for step 3
-void step3(void) {
-	uint8 counter = 0, Entered_pass[6];
+// Control reports that nobody is detected anymore
+static App_StateType on_people_passed(void) {
+	if ((frame.command != MOTION_STATUS) || (frame.length != 1)
+			|| (frame.payload[0] != people_notdetected)) {
+		return state;
+	}
 	LCD_clearScreen();
-	LCD_displayStringRowColumn(0, 0, "enter door pass: ");
-	LCD_moveCursor(1, 0);
+	show_message(0, 2, MSG_DOOR_LOCKING);
+	start_timer(DOOR_LOCKING_TIME);
+	return STATE_DOOR_LOCKING;
+}
 
-	// Get entered password from user input
-	for (counter = 0; counter < PASS_SIZE; counter++) {
-		uint8 read = KEYPAD_getPressedKey();
-		if (read >= 0 && read <= 9) { // Check if the key is a valid digit
-			Entered_pass[counter] = read; //store read in Entered_pass
-			_delay_ms(300); //small delay for stability
-			LCD_displayCharacter('*'); // Display asterisk for security
-		} else {
-			counter--; // Decrement counter if invalid key is pressed
+// No response in time: send the request again, or give up after REQUEST_RETRIES
+static App_StateType on_response_timeout(void) {
+	if (request_retries < REQUEST_RETRIES) {
+		request_retries++;
+		COUNT_SATURATED(retransmits);
+		transmit_request();
+		return state;
+	}
+	baud_fallback = TRUE; // Control may not follow the negotiated rate anymore
+	LCD_clearScreen();
+	show_message(0, 1, MSG_NO_REPLY);
+	show_message(1, 2, MSG_CONTROL_ECU);
+	start_timer(LINK_ERROR_TIME);
+	return STATE_LINK_ERROR;
+}
+
+// Back to the screen the failed request started from
+static App_StateType on_link_error_done(void) {
+	if (request_command == SAVE_PASS_and_confirm) {
+		return show_enter_pass(); // No password saved yet
+	}
+	return show_main_menu();
+}
+
+/*******************************************************************************
+ *                      Transition table                                       *
+ *******************************************************************************/
+
+static const App_TransitionType transitions[] = {
+	{ STATE_ENTER_PASS,         EVENT_KEY_DIGIT, on_digit },
+	{ STATE_ENTER_PASS,         EVENT_KEY_ENTER, on_pass_entered },
+	{ STATE_CONFIRM_PASS,       EVENT_KEY_DIGIT, on_digit },
+	{ STATE_CONFIRM_PASS,       EVENT_KEY_ENTER, on_confirm_entered },
+	{ STATE_WAIT_SAVE_RESULT,   EVENT_FRAME,     on_save_result },
+	{ STATE_WAIT_SAVE_RESULT,   EVENT_TIMEOUT,   on_response_timeout },
+	{ STATE_MAIN_MENU,          EVENT_KEY_PLUS,  on_open_door },
+	{ STATE_MAIN_MENU,          EVENT_KEY_MINUS, on_change_pass },
+	{ STATE_CHECK_PASS,         EVENT_KEY_DIGIT, on_digit },
+	{ STATE_CHECK_PASS,         EVENT_KEY_ENTER, on_check_entered },
+	{ STATE_WAIT_CHECK_RESULT,  EVENT_FRAME,     on_check_result },
+	{ STATE_WAIT_CHECK_RESULT,  EVENT_TIMEOUT,   on_response_timeout },
+	{ STATE_DOOR_UNLOCKING,     EVENT_TIMEOUT,   on_unlocking_done },
+	{ STATE_WAIT_MOTION_STATUS, EVENT_FRAME,     on_motion_status },
+	{ STATE_WAIT_MOTION_STATUS, EVENT_TIMEOUT,   on_response_timeout },
+	{ STATE_WAIT_PEOPLE,        EVENT_FRAME,     on_people_passed },
+	{ STATE_WAIT_PEOPLE,        EVENT_TIMEOUT,   on_unlocking_done },
+	{ STATE_DOOR_LOCKING,       EVENT_TIMEOUT,   show_main_menu },
+	{ STATE_SYSTEM_LOCKED,      EVENT_TIMEOUT,   show_main_menu },
+	{ STATE_LINK_ERROR,         EVENT_TIMEOUT,   on_link_error_done },
+};
+
+#define NUM_OF_TRANSITIONS (sizeof(transitions) / sizeof(transitions[0]))
+
+// Map a pressed key to its event
+static App_EventType key_event(uint8 key) {
+	if (key <= 9) {
+		return EVENT_KEY_DIGIT;
+	} else if (key == Enter) {
+		return EVENT_KEY_ENTER;
+	} else if (key == '+') {
+		return EVENT_KEY_PLUS;
+	} else if (key == '-') {
+		return EVENT_KEY_MINUS;
+	}
+	return EVENT_NONE;
+}
+
+/*
+ * Run the action of the event in the current state. Events without a row in
+ * the table are ignored. Actions never wait (requests are answered by a later
+ * EVENT_FRAME), so each event costs at most one table scan, one action and
+ * one LCD flush.
+ */
+void App_dispatch(App_EventType event) {
+	uint8 i;
+	uint32 start_us = Timer_nowUs();
+	uint32 elapsed_us;
+
+	for (i = 0; i < NUM_OF_TRANSITIONS; i++) {
+		if ((transitions[i].state == state) && (transitions[i].event == event)) {
+			state = transitions[i].action();
+			break;
 		}
 	}
+	LCD_flush(); // Queue the changed cells of the new screen
 
-	Entered_pass[counter] = '\0'; // Null-terminate the string
-	while (KEYPAD_getPressedKey() != Enter)
-		; // Wait for Enter key
-	_delay_ms(300);
+	elapsed_us = Timer_nowUs() - start_us;
+	if (elapsed_us > dispatch_max_us) {
+		dispatch_max_us = elapsed_us; // Keep the per-transition worst case
+	}
+}
 
-	UART_sendByte(CHECK_PASS); // Send check password command
-	while (UART_recieveByte() != CONTROL_ready)
-		; // Wait for control acknowledgment
-	UART_sendString(Entered_pass); // Send entered password
-	UART_sendByte('#'); // End of string
+/*
+ * Description :
+ * Returns TRUE if the main loop has something to handle: a key event, received
+ * bytes or deferred timer work. Called with interrupts disabled before sleeping.
+ */
+static boolean work_pending(void) {
+	return KEYPAD_eventPending() || (UART_available() != 0)
+			|| Timer_deferredPending();
 }
 
+int main(void) {
+	KEYPAD_EventType key;
+
+	// Enable global interrupts
+	SREG_REG.Bits.I_Bit = LOGIC_HIGH;
+
+	// Initialize LCD
+	LCD_init();
+
+	// Initialize keypad background scan
+	KEYPAD_init();
+
+	// Start the system tick of the software timers
+	Timer_startTick();
+
+	// UART configuration and initialization
+#if (HMI_NODE_ADDRESS != UART_NO_ADDRESS)
+	UART_ConfigType config = { NINE_BITS, DISABLED, one_bit,
+			UART_BAUD_SETTING(HMI_BAUD_RATE), HMI_NODE_ADDRESS };
+#else
+	UART_ConfigType config = { EIGHT_BITS, DISABLED, one_bit,
+			UART_BAUD_SETTING(HMI_BAUD_RATE), UART_NO_ADDRESS };
+#endif
+	UART_init(&config);
+	PROTOCOL_init();
+
+	// Start with the first step of password creating
+	state = show_enter_pass();
+	LCD_flush();
+
+	// Move the link to the highest rate both ECUs support (baud_max stays 0 on a bus)
+#if (HMI_NODE_ADDRESS == UART_NO_ADDRESS)
+	while ((baud_max + 1 < NUM_OF_BAUDS) && link_bauds[baud_max + 1].usable) {
+		baud_max++;
+	}
+#endif
+	negotiate_baud();
+
+	// Main loop: turn keys, frames and timeouts into events
+	for (;;) {
+		if (KEYPAD_pollEvent(&key) && (key.kind == KEYPAD_KEY_PRESSED)) {
+			pressed_key = key.key;
+			App_dispatch(key_event(pressed_key));
+		}
+		if (PROTOCOL_pollFrame(&frame)) {
+			UART_clearLineErrors(); // The line works at this rate
+			if (frame.command == SET_BAUD) {
+				on_baud_response();
+			} else if (frame.command == LINK_STATS) {
+				send_link_stats();
+			} else {
+				App_dispatch(EVENT_FRAME);
+			}
+		}
+		Timer_dispatchDeferred(); // Timer1 callbacks
+		if ((HMI_NODE_ADDRESS == UART_NO_ADDRESS) // The bus rate is not this panel's
+				&& (baud_fallback || (UART_lineErrors() >= BAUD_FALLBACK_ERRORS))) {
+			fall_back_baud();
+		}
+
+		// Sleep until the next interrupt if nothing is left to handle
+		SREG_REG.Bits.I_Bit = LOGIC_LOW;
+		if (work_pending()) {
+			SREG_REG.Bits.I_Bit = LOGIC_HIGH;
+		} else {
+			Power_idle(); // Returns with interrupts enabled
+		}
+	}
+}
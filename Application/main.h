@@ -8,11 +8,14 @@
  *******************************************************************************/
 #ifndef MAIN_H_
 #define MAIN_H_
+
+#include "../imp_files/io_access.h"
+
 /*******************************************************************************
  *                                Definitions                                  *
  *******************************************************************************/
 // Register definition for the status register (SREG)
-#define SREG_REG      (*(volatile SREG_Type*)0x5F)
+#define SREG_REG      (*(volatile SREG_Type*)IO_ADDRESS(0x5F))
 
 // size of the password
 #define PASS_SIZE 5
@@ -21,25 +24,67 @@
 #define matched 1
 #define unmatched 0
 
-// Communication codes between HMI and Control
-#define HMI_ready 0x01
-#define CONTROL_ready 0x02
-#define OPEN_DOOR 0X03
-#define CHANGE_PASS 0X04
-#define SAVE_PASS_and_confirm 0X05
-#define CHECK_PASS 0X06
-#define recieve_result 0x44
+// Frame command IDs between HMI and Control (see Protocol.h)
+// Each request gets one response frame with the same command and sequence
+#define OPEN_DOOR 0X03             // payload: password, response: matched/unmatched
+#define CHANGE_PASS 0X04           // payload: password, response: matched/unmatched
+#define SAVE_PASS_and_confirm 0X05 // payload: password + confirmation, response: matched/unmatched
+#define MOTION_STATUS 0X07         // no payload, response: people_detected/people_notdetected
+#define SET_BAUD 0X08              // payload: highest baud rate index, response: index both switch to
+
+// Diagnostic request from Control (or a service tool on the link), answered by the HMI
+// payload: none, or 1 byte not 0 to clear the counters once read, response: App_StatType counters
+#define LINK_STATS 0X09
 
 // Motion detection status
 #define people_detected 1
 #define people_notdetected 0
 
-// Alarm signal code
+// Alarm command ID (no payload, acknowledged with an empty response)
 #define Alarm 0x55
 
 // Key code for Enter key
 #define Enter 13
 
+// Baud rate the link to the Control ECU starts at, first rate of the negotiation table
+#define HMI_BAUD_RATE 9600
+
+// Rates of the negotiation table (link_bauds in main.c), and line errors
+// (frame error, overrun) without a valid frame before a lower rate is used
+#define NUM_OF_BAUDS 5
+#define BAUD_FALLBACK_ERRORS 4
+
+// Longest wait for the queued bytes to be sent before a baud rate change
+#define BAUD_SWITCH_TIMEOUT_MS 100
+
+// Address of this panel when several HMIs share the bus of one Control ECU
+// (1..254, 9-bit frames), 0 for a point-to-point link (8-bit frames)
+#ifndef HMI_NODE_ADDRESS
+#define HMI_NODE_ADDRESS 0
+#endif
+
+// Failed password attempts before the system is locked
+#define MAX_PASS_FAULTS 3
+
+// Software timer used for the timed screens and the response timeout
+#define SCREEN_TIMER_ID 0
+
+// Software timer of the SET_BAUD response timeout
+#define BAUD_TIMER_ID 1
+
+// Timed screens durations in seconds
+#define DOOR_UNLOCKING_TIME 15
+#define DOOR_LOCKING_TIME 15
+#define SYSTEM_LOCKED_TIME 60
+#define LINK_ERROR_TIME 3
+
+// Time people may take before the sensor status is asked again, in seconds
+#define PEOPLE_TIMEOUT_TIME 60
+
+// Time to wait for a response, and times a request is sent again before giving up
+#define RESPONSE_TIMEOUT_MS 500
+#define REQUEST_RETRIES 2
+
 /*******************************************************************************
  *                      Types Declaration                                    *
  *******************************************************************************/
@@ -59,22 +104,96 @@ typedef union {
 	} Bits; // Individual bits
 } SREG_Type;
 
+// Application states
+typedef enum {
+	STATE_ENTER_PASS,         // Creating a new password
+	STATE_CONFIRM_PASS,       // Re-entering the new password
+	STATE_WAIT_SAVE_RESULT,   // Waiting for Control to compare both passwords
+	STATE_MAIN_MENU,          // "+ : Open Door" / "- : Change Pass"
+	STATE_CHECK_PASS,         // Entering the password for the chosen operation
+	STATE_WAIT_CHECK_RESULT,  // Waiting for Control to check the password
+	STATE_DOOR_UNLOCKING,     // Door is opening
+	STATE_WAIT_MOTION_STATUS, // Waiting for the people sensor status
+	STATE_WAIT_PEOPLE,        // Waiting for people to pass the door
+	STATE_DOOR_LOCKING,       // Door is closing
+	STATE_SYSTEM_LOCKED,      // Too many wrong passwords, alarm is on
+	STATE_LINK_ERROR,         // Control did not answer a request
+	NUM_OF_STATES
+} App_StateType;
+
+// Application events
+typedef enum {
+	EVENT_KEY_DIGIT,   // Key 0..9 pressed
+	EVENT_KEY_ENTER,   // Enter key pressed
+	EVENT_KEY_PLUS,    // '+' key pressed
+	EVENT_KEY_MINUS,   // '-' key pressed
+	EVENT_FRAME,       // Frame received from Control
+	EVENT_TIMEOUT,     // Timed screen finished or no response in time
+	EVENT_NONE         // Nothing to handle (other keys)
+} App_EventType;
+
+// Texts shown on the LCD, index of the flash message table in main.c
+typedef enum {
+	MSG_ENTER_PASS,
+	MSG_REENTER_PASS,
+	MSG_SAME_PASS,
+	MSG_MENU_OPEN_DOOR,
+	MSG_MENU_CHANGE_PASS,
+	MSG_ENTER_DOOR_PASS,
+	MSG_SYSTEM_LOCKED,
+	MSG_WAIT_1_MIN,
+	MSG_DOOR_UNLOCKING,
+	MSG_PLEASE_WAIT,
+	MSG_WAIT_FOR_PEOPLE,
+	MSG_TO_ENTER,
+	MSG_DOOR_LOCKING,
+	MSG_NO_REPLY,
+	MSG_CONTROL_ECU,
+	NUM_OF_MESSAGES
+} App_MessageType;
+
+// Baud rate negotiation steps, beside the application states
+typedef enum {
+	BAUD_IDLE,        // Link at baud_index, nothing pending
+	BAUD_WAIT_OFFER,  // SET_BAUD sent at HMI_BAUD_RATE, waiting for the agreed rate
+	BAUD_WAIT_CHECK   // SET_BAUD sent again at the agreed rate, waiting for it to work
+} App_BaudStateType;
+
+// One rate of the negotiation table, its index is sent in the SET_BAUD frames
+typedef struct {
+	uint16 setting;   // UART_BAUD_SETTING of the rate
+	boolean usable;   // UART_BAUD_OK: within 2% at this F_CPU
+} App_BaudType;
+
+// LINK_STATS response payload: 16-bit link counters, low byte first, in this order
+typedef enum {
+	STAT_FRAMES_RECEIVED, // Frames with a valid CRC
+	STAT_BYTES_RECEIVED,  // Bytes stored by the UART
+	STAT_OVERRUNS,        // Data overruns (DOR)
+	STAT_FRAME_ERRORS,    // Frame errors (FE)
+	STAT_PARITY_ERRORS,   // Parity errors (PE)
+	STAT_CRC_ERRORS,      // Frames dropped for a wrong CRC
+	STAT_RETRANSMITS,     // Requests sent again after no response
+	STAT_RX_OVERFLOWS,    // Bytes dropped, UART RX buffer full
+	STAT_FRAMES_SENT,     // Frames sent, requests and responses
+	STAT_CUT_FRAMES,      // Partial frames dropped for a bad length or a gap (lost byte)
+	NUM_OF_STATS
+} App_StatType;
+
+// Transition action: runs on an event and returns the next state
+typedef App_StateType (*App_ActionType)(void);
+
+// One row of the transition table
+typedef struct {
+	App_StateType state;   // Current state
+	App_EventType event;   // Event handled in this state
+	App_ActionType action; // Action that returns the next state
+} App_TransitionType;
+
 /*******************************************************************************
  *                      Functions Prototypes                                   *
  *******************************************************************************/
-/* Function to handle the first step of password creating*/
-void step1(void);
-/* Function to handle step 2 of the system and show main options*/
-void step2(void);
-/* Function to manage waiting during door unlocking*/
-void display_wait(void);
-/* Function to prompt for password entry*/
-void step3(void);
-/* Function to display Door Unlocking if passwords matched*/
-void Door_unlocking(void);
-/* Function to handle password change*/
-void pass_change(void);
-/* Function to display alarm messages*/
-void Alarm_message(void);
+/* Function to run the action of the event in the current state*/
+void App_dispatch(App_EventType event);
 
 #endif /* MAIN_H_ */
@@ -0,0 +1,49 @@
+/******************************************************************************
+ *
+ * Module: BENCH
+ *
+ * File Name: bench.h
+ *
+ * Description: Benchmark cases shared by the AVR harness and the simavr runner
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+
+/*
+ * The harness writes the case number to this register right before the call
+ * and BENCH_END right after it. TWBR is free: the HMI board has no TWI device.
+ */
+#define BENCH_MARKER_ADDRESS   0x20
+#define BENCH_END              0
+
+/* Key held down by the runner during BENCH_KEYPAD_GET_PRESSED_KEY (row 1, column 1) */
+#define BENCH_KEY_ROW          1
+#define BENCH_KEY_COL          1
+
+/*******************************************************************************
+ *                      Types Declaration                                      *
+ *******************************************************************************/
+
+typedef enum {
+    BENCH_OVERHEAD = 1,              // Marker writes only, subtracted from the others
+    BENCH_GPIO_WRITE_PIN,
+    BENCH_GPIO_WRITE_PIN_INLINE,
+    BENCH_GPIO_READ_PIN,
+    BENCH_GPIO_WRITE_PORT,
+    BENCH_LCD_DISPLAY_CHARACTER,
+    BENCH_LCD_DISPLAY_STRING_ROW_COLUMN,
+    BENCH_LCD_FLUSH,
+    BENCH_KEYPAD_GET_PRESSED_KEY,
+    BENCH_UART_SEND_STRING,
+    BENCH_NUM_OF_CASES
+} BENCH_CaseType;
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,90 @@
+/******************************************************************************
+ *
+ * Module: BENCH
+ *
+ * File Name: bench_main.c
+ *
+ * Description: AVR harness calling each driver entry point once with fixed
+ *              inputs, between two writes of the benchmark marker register
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+/*
+ * Runs with interrupts disabled: the numbers are those of the call alone,
+ * without the Timer/UART interrupts of the application. The drivers then do
+ * their interrupt work inline, so LCD_flush includes the LCD bus transfers and
+ * KEYPAD_getPressedKey includes the debounce scans.
+ */
+
+#include "bench.h"
+#include "../MCAL_Drivers/GPIO.h"
+#include "../MCAL_Drivers/UART.h"
+#include "../HAL_Drivers/LCD.h"
+#include "../HAL_Drivers/keypad.h"
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#define BENCH_MARKER_REG (*(volatile uint8*)BENCH_MARKER_ADDRESS)
+
+#define BENCH_START(id)  (BENCH_MARKER_REG = (id))
+#define BENCH_STOP()     (BENCH_MARKER_REG = BENCH_END)
+
+/* Results go to a volatile so the calls are not optimized away */
+volatile uint8 bench_result;
+
+int main(void) {
+    UART_ConfigType config = { EIGHT_BITS, DISABLED, one_bit, UART_BAUD_SETTING(9600),
+            UART_NO_ADDRESS };
+
+    cli();
+    LCD_init();
+    KEYPAD_init();
+    UART_init(&config);
+
+    BENCH_START(BENCH_OVERHEAD);
+    BENCH_STOP();
+
+    BENCH_START(BENCH_GPIO_WRITE_PIN);
+    GPIO_writePin(PORTD_ID, PIN7_ID, LOGIC_HIGH);
+    BENCH_STOP();
+
+    BENCH_START(BENCH_GPIO_WRITE_PIN_INLINE);
+    GPIO_writePinInline(PORTD_ID, PIN7_ID, LOGIC_LOW);
+    BENCH_STOP();
+
+    BENCH_START(BENCH_GPIO_READ_PIN);
+    bench_result = GPIO_readPin(PORTD_ID, PIN2_ID);
+    BENCH_STOP();
+
+    BENCH_START(BENCH_GPIO_WRITE_PORT);
+    GPIO_writePort(PORTD_ID, 0x80);
+    BENCH_STOP();
+
+    BENCH_START(BENCH_LCD_DISPLAY_CHARACTER);
+    LCD_displayCharacter('A');
+    BENCH_STOP();
+
+    BENCH_START(BENCH_LCD_DISPLAY_STRING_ROW_COLUMN);
+    LCD_displayStringRowColumn(1, 0, "0123456789ABCDEF");
+    BENCH_STOP();
+
+    BENCH_START(BENCH_LCD_FLUSH);
+    LCD_flush();
+    BENCH_STOP();
+
+    BENCH_START(BENCH_KEYPAD_GET_PRESSED_KEY);
+    bench_result = KEYPAD_getPressedKey();
+    BENCH_STOP();
+
+    BENCH_START(BENCH_UART_SEND_STRING);
+    UART_sendString((const uint8 *)"0123456789ABCDEF");
+    BENCH_STOP();
+
+    /* Sleeping with interrupts disabled ends the simulation */
+    sleep_enable();
+    sleep_cpu();
+    for (;;) {
+    }
+}
@@ -0,0 +1,294 @@
+/******************************************************************************
+ *
+ * Module: BENCH
+ *
+ * File Name: cycle_bench.c
+ *
+ * Description: Runs the benchmark harness on simavr and reports the cycles,
+ *              stack and flash of each driver entry point, compared with a
+ *              stored baseline
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+/*
+ * usage: cycle_bench [-b baseline.csv] [-t percent] bench.elf bench.sym
+ *
+ * bench.sym is the output of "avr-nm -S --defined-only bench.elf". The CSV
+ * goes to stdout, the comparison with the baseline to stderr. The exit status
+ * is 1 if a case got slower by more than the tolerance, or uses more stack or
+ * flash than in the baseline, or if the baseline can't be read: without it
+ * nothing is checked.
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_io.h>
+#include <avr_ioport.h>
+#include <avr_uart.h>
+
+#define BENCH_MCU              "atmega32"
+#define BENCH_MAX_CYCLES       100000000ULL  // The harness is stuck if it runs longer
+#define BENCH_STACK_PATTERN    0xA5
+
+/* Keypad wiring, see KEYPAD_ROW_PORT_ID/KEYPAD_COL_PORT_ID in keypad.h */
+#define BENCH_KEYPAD_PORT      'B'
+#define BENCH_KEYPAD_DDR       0x37
+#define BENCH_KEYPAD_PORT_REG  0x38
+#define BENCH_FIRST_ROW_PIN    0
+#define BENCH_FIRST_COL_PIN    4
+#define BENCH_NUM_OF_COLS      4
+
+typedef struct {
+    const char *name;       // Also the symbol the flash size is taken from, if any
+    uint64_t cycles;
+    unsigned int stack;
+    unsigned int flash;
+    int done;
+} BENCH_ResultType;
+
+static BENCH_ResultType g_results[BENCH_NUM_OF_CASES] = {
+    [BENCH_OVERHEAD] = { "overhead" },
+    [BENCH_GPIO_WRITE_PIN] = { "GPIO_writePin" },
+    [BENCH_GPIO_WRITE_PIN_INLINE] = { "GPIO_writePinInline" }, // Inlined: no flash of its own
+    [BENCH_GPIO_READ_PIN] = { "GPIO_readPin" },
+    [BENCH_GPIO_WRITE_PORT] = { "GPIO_writePort" },
+    [BENCH_LCD_DISPLAY_CHARACTER] = { "LCD_displayCharacter" },
+    [BENCH_LCD_DISPLAY_STRING_ROW_COLUMN] = { "LCD_displayStringRowColumn" },
+    [BENCH_LCD_FLUSH] = { "LCD_flush" },
+    [BENCH_KEYPAD_GET_PRESSED_KEY] = { "KEYPAD_getPressedKey" },
+    [BENCH_UART_SEND_STRING] = { "UART_sendString" },
+};
+
+static uint8_t g_case = BENCH_END;
+static uint64_t g_startCycle;
+static uint16_t g_startSp;
+static uint16_t g_stackBottom;  // First byte above .bss and .data (__bss_end)
+
+static uint8_t g_ddr = 0;
+static uint8_t g_port = 0;
+static avr_irq_t *g_keyColumn;
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+static uint16_t BENCH_sp(avr_t *avr) {
+    return (uint16_t)(avr->data[R_SPL] | (avr->data[R_SPH] << 8));
+}
+
+/*
+ * Start marker: paint the free stack so the depth reached by the call can be
+ * found afterwards. Stop marker: record the cycles and the stack depth.
+ */
+static void BENCH_markerWrite(avr_t *avr, avr_io_addr_t addr, uint8_t value, void *param) {
+    uint16_t address;
+
+    if (value != BENCH_END) {
+        if ((value >= BENCH_NUM_OF_CASES) || (g_results[value].name == NULL)) {
+            fprintf(stderr, "cycle_bench: unknown case %u\n", value);
+            exit(EXIT_FAILURE);
+        }
+        g_case = value;
+        g_startSp = BENCH_sp(avr);
+        memset(&avr->data[g_stackBottom], BENCH_STACK_PATTERN, g_startSp + 1 - g_stackBottom);
+        g_startCycle = avr->cycle;
+        return;
+    }
+    if (g_case == BENCH_END) {
+        return;
+    }
+    for (address = g_stackBottom; address <= g_startSp; address++) {
+        if (avr->data[address] != BENCH_STACK_PATTERN) {
+            break;
+        }
+    }
+    g_results[g_case].cycles = avr->cycle - g_startCycle;
+    g_results[g_case].stack = g_startSp + 1 - address;
+    g_results[g_case].done = 1;
+    g_case = BENCH_END;
+}
+
+/*
+ * The benchmark key connects its column to its row: the column reads low while
+ * the scan drives the row low. The other columns stay high (pull-ups).
+ */
+static void BENCH_keypadWrite(avr_t *avr, avr_io_addr_t addr, uint8_t value, void *param) {
+    uint8_t row = 1 << (BENCH_FIRST_ROW_PIN + BENCH_KEY_ROW);
+
+    if (addr == BENCH_KEYPAD_DDR) {
+        g_ddr = value;
+    } else {
+        g_port = value;
+    }
+    avr_raise_irq(g_keyColumn, !((g_case == BENCH_KEYPAD_GET_PRESSED_KEY)
+            && (g_ddr & row) && !(g_port & row)));
+}
+
+static void BENCH_readSymbols(const char *file) {
+    FILE *stream = fopen(file, "r");
+    char line[256];
+    char name[128];
+    char type;
+    unsigned long address, size;
+    int i;
+
+    if (stream == NULL) {
+        perror(file);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), stream)) {
+        if (sscanf(line, "%lx %lx %c %127s", &address, &size, &type, name) == 4) {
+            for (i = 0; i < BENCH_NUM_OF_CASES; i++) {
+                if (g_results[i].name && !strcmp(g_results[i].name, name)) {
+                    g_results[i].flash = (unsigned int)size;
+                }
+            }
+        } else if ((sscanf(line, "%lx %c %127s", &address, &type, name) == 3)
+                && !strcmp(name, "__bss_end")) {
+            g_stackBottom = (uint16_t)(address & 0xFFFF); // Data addresses start at 0x800000
+        }
+    }
+    fclose(stream);
+    if (g_stackBottom == 0) {
+        fprintf(stderr, "cycle_bench: no __bss_end in %s\n", file);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Compare with the baseline, returns the number of regressions
+static int BENCH_compare(const char *file, double tolerance) {
+    FILE *stream = fopen(file, "r");
+    char line[256];
+    char name[128];
+    unsigned long long cycles;
+    unsigned int stack, flash;
+    int regressions = 0;
+    int i;
+
+    if (stream == NULL) {
+        fprintf(stderr, "cycle_bench: no baseline %s, record one with make baseline\n", file);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), stream)) {
+        if (sscanf(line, "%127[^,],%llu,%u,%u", name, &cycles, &stack, &flash) != 4) {
+            continue; // Header
+        }
+        for (i = 0; i < BENCH_NUM_OF_CASES; i++) {
+            if (!g_results[i].done || strcmp(g_results[i].name, name)) {
+                continue;
+            }
+            if ((g_results[i].cycles > cycles * (1.0 + tolerance / 100.0))
+                    || (g_results[i].stack > stack) || (g_results[i].flash > flash)) {
+                fprintf(stderr, "REGRESSION %-28s cycles %llu -> %llu, stack %u -> %u, flash %u -> %u\n",
+                        name, cycles, (unsigned long long)g_results[i].cycles, stack,
+                        g_results[i].stack, flash, g_results[i].flash);
+                regressions++;
+            } else if ((g_results[i].cycles != cycles) || (g_results[i].stack != stack)
+                    || (g_results[i].flash != flash)) {
+                fprintf(stderr, "changed    %-28s cycles %llu -> %llu, stack %u -> %u, flash %u -> %u\n",
+                        name, cycles, (unsigned long long)g_results[i].cycles, stack,
+                        g_results[i].stack, flash, g_results[i].flash);
+            }
+        }
+    }
+    fclose(stream);
+    return regressions;
+}
+
+static void BENCH_usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [-b baseline.csv] [-t percent] bench.elf bench.sym\n"
+            "  -b file     compare with this baseline\n"
+            "  -t percent  extra cycles allowed before a case is a regression (0)\n", program);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    elf_firmware_t firmware;
+    avr_t *avr;
+    const char *baseline = NULL;
+    double tolerance = 0;
+    uint32_t flags = 0;
+    int state;
+    int option;
+    int i;
+
+    while ((option = getopt(argc, argv, "b:t:")) != -1) {
+        switch (option) {
+        case 'b':
+            baseline = optarg;
+            break;
+        case 't':
+            tolerance = strtod(optarg, NULL);
+            break;
+        default:
+            BENCH_usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2) {
+        BENCH_usage(argv[0]);
+    }
+
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[optind], &firmware) != 0) {
+        fprintf(stderr, "cycle_bench: cannot load %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    BENCH_readSymbols(argv[optind + 1]);
+
+    avr = avr_make_mcu_by_name(BENCH_MCU);
+    if (avr == NULL) {
+        fprintf(stderr, "cycle_bench: simavr has no %s\n", BENCH_MCU);
+        return EXIT_FAILURE;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = F_CPU;
+
+    avr_register_io_write(avr, BENCH_MARKER_ADDRESS, BENCH_markerWrite, NULL);
+    avr_register_io_write(avr, BENCH_KEYPAD_DDR, BENCH_keypadWrite, NULL);
+    avr_register_io_write(avr, BENCH_KEYPAD_PORT_REG, BENCH_keypadWrite, NULL);
+    for (i = 0; i < BENCH_NUM_OF_COLS; i++) {
+        avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BENCH_KEYPAD_PORT),
+                BENCH_FIRST_COL_PIN + i), 1);
+    }
+    g_keyColumn = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BENCH_KEYPAD_PORT),
+            BENCH_FIRST_COL_PIN + BENCH_KEY_COL);
+
+    // Keep the UART output off the CSV
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+    do {
+        state = avr_run(avr);
+    } while ((state != cpu_Done) && (state != cpu_Crashed) && (avr->cycle < BENCH_MAX_CYCLES));
+    if (state != cpu_Done) {
+        fprintf(stderr, "cycle_bench: the harness %s\n", (state == cpu_Crashed) ? "crashed" : "did not finish");
+        return EXIT_FAILURE;
+    }
+
+    printf("function,cycles,stack_bytes,flash_bytes\n");
+    for (i = BENCH_OVERHEAD + 1; i < BENCH_NUM_OF_CASES; i++) {
+        if (!g_results[i].done) {
+            fprintf(stderr, "cycle_bench: %s did not run\n", g_results[i].name);
+            return EXIT_FAILURE;
+        }
+        g_results[i].cycles -= g_results[BENCH_OVERHEAD].cycles;
+        printf("%s,%llu,%u,%u\n", g_results[i].name, (unsigned long long)g_results[i].cycles,
+                g_results[i].stack, g_results[i].flash);
+    }
+    fflush(stdout);
+
+    if ((baseline != NULL) && BENCH_compare(baseline, tolerance)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -14,8 +14,284 @@
 
 #include <util/delay.h> /* For the delay functions */
 #include <stdlib.h>
+#include <avr/pgmspace.h> /* For the strings in flash */
 #include "../MCAL_Drivers/GPIO.h"
-#include "../imp_files/common_macros.h" /* For GET_BIT Macro */
+#include "../MCAL_Drivers/Timer.h"
+#include "../imp_files/common_macros.h" /* For BIT_IS_CLEAR Macro */
+
+/*******************************************************************************
+ *                      Private Variables                                      *
+ *******************************************************************************/
+
+#define LCD_ADDRESS_UNKNOWN            0xFF
+
+#if (LCD_DATA_BITS_MODE == 4)
+/* DB4..DB7 are written as one nibble, so they must be consecutive pins of the port */
+#if ((LCD_DB5_PIN_ID != LCD_DB4_PIN_ID + 1) || (LCD_DB6_PIN_ID != LCD_DB4_PIN_ID + 2) \
+		|| (LCD_DB7_PIN_ID != LCD_DB4_PIN_ID + 3))
+#error "LCD_DB4_PIN_ID..LCD_DB7_PIN_ID should be consecutive pins"
+#endif
+#define LCD_DATA_NIBBLE_MASK           ((uint8)(0x0F << LCD_DB4_PIN_ID))
+#endif
+
+/* Shadow framebuffer: what the application wants to be displayed */
+static uint8 g_LCD_frame[LCD_NUM_ROWS][LCD_NUM_COLS];
+
+/* What is currently displayed on the LCD DDRAM */
+static uint8 g_LCD_glass[LCD_NUM_ROWS][LCD_NUM_COLS];
+
+/* DDRAM address the LCD will write the next character to */
+static uint8 g_LCD_address = LCD_ADDRESS_UNKNOWN;
+
+#if (LCD_USE_BUSY_FLAG == 1)
+/* Busy flag can be polled (only after the interface width is set) */
+static volatile boolean g_LCD_busyFlagReady = FALSE;
+static volatile uint16 g_LCD_busyTicks = 0; /* Ticks the LCD stayed busy */
+#endif
+
+/* Status register, used to know if the blocking calls run with interrupts disabled */
+#define LCD_SREG_REG (*(volatile uint8*)IO_ADDRESS(0x5F))
+#define LCD_SREG_I_bitNum 7
+
+/* Timer0 in CTC mode paces the queue, one bus transaction every LCD_TICK_US */
+#define LCD_TICK_PRESCALER TIMER_PRESCALER(LCD_TICK_US, 256)
+
+#if (LCD_TICK_PRESCALER == 0) || (TIMER_ERROR(LCD_TICK_US, LCD_TICK_PRESCALER) > TIMER_MAX_PERIOD_ERROR)
+#error "LCD_TICK_US can't be produced by Timer0 at this F_CPU"
+#endif
+
+static const Timer_ConfigType g_LCD_timerConfig = { 0,
+		(uint16)TIMER_COMPARE(LCD_TICK_US, LCD_TICK_PRESCALER), TIMER0_ID,
+		TIMER_CLOCK(LCD_TICK_PRESCALER), CTC_0_OR_2 };
+
+/* Bus transactions waiting to be sent by the Timer0 interrupt */
+typedef struct {
+	uint8 rs_value; /* LOGIC_LOW for an instruction, LOGIC_HIGH for data */
+	uint8 value;
+} LCD_QueueEntryType;
+
+static volatile LCD_QueueEntryType g_LCD_queue[LCD_QUEUE_SIZE];
+static volatile uint8 g_LCD_queueHead = 0; /* Next free entry (owned by the callers) */
+static volatile uint8 g_LCD_queueTail = 0; /* Next entry to send (owned by the interrupt) */
+static volatile uint8 g_LCD_holdTicks = 0; /* Ticks left for a slow instruction to execute */
+static volatile boolean g_LCD_queueRunning = FALSE; /* Timer0 is draining the queue */
+
+/* Drawing cursor inside the shadow framebuffer */
+static uint8 g_LCD_row = 0;
+static uint8 g_LCD_col = 0;
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+#if (LCD_USE_BUSY_FLAG == 1)
+/*
+ * Description :
+ * Read the LCD busy flag (DB7) once, returns LOGIC_HIGH while the LCD is busy
+ */
+static uint8 LCD_readBusyFlag(void) {
+	uint8 busy;
+
+	/* Release the data bus and select busy flag read: RS=0, RW=1 */
+#if(LCD_DATA_BITS_MODE == 4)
+	GPIO_setupPinDirectionInline(LCD_DATA_PORT_ID,LCD_DB4_PIN_ID,PIN_INPUT);
+	GPIO_setupPinDirectionInline(LCD_DATA_PORT_ID,LCD_DB5_PIN_ID,PIN_INPUT);
+	GPIO_setupPinDirectionInline(LCD_DATA_PORT_ID,LCD_DB6_PIN_ID,PIN_INPUT);
+	GPIO_setupPinDirectionInline(LCD_DATA_PORT_ID,LCD_DB7_PIN_ID,PIN_INPUT);
+#elif(LCD_DATA_BITS_MODE == 8)
+	GPIO_setupPortDirectionInline(LCD_DATA_PORT_ID, PORT_INPUT);
+#endif
+	GPIO_writePinInline(LCD_RS_PORT_ID, LCD_RS_PIN_ID, LOGIC_LOW);
+	GPIO_writePinInline(LCD_RW_PORT_ID, LCD_RW_PIN_ID, LOGIC_HIGH);
+
+	GPIO_writePinInline(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_HIGH); /* Enable LCD E=1 */
+	_delay_us(1); /* delay for data output tDDR = 160ns */
+	busy = GPIO_readPinInline(LCD_DATA_PORT_ID, LCD_DB7_PIN_ID); /* BF is on DB7 */
+	GPIO_writePinInline(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_LOW); /* Disable LCD E=0 */
+	_delay_us(1); /* delay for Enable cycle time tcycE = 500ns */
+#if(LCD_DATA_BITS_MODE == 4)
+	/* Clock out the low nibble (address counter) too */
+	GPIO_writePinInline(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_HIGH);
+	_delay_us(1);
+	GPIO_writePinInline(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_LOW);
+	_delay_us(1);
+#endif
+
+	/* Take the data bus back: RW=0 */
+	GPIO_writePinInline(LCD_RW_PORT_ID, LCD_RW_PIN_ID, LOGIC_LOW);
+#if(LCD_DATA_BITS_MODE == 4)
+	GPIO_setupPinDirectionInline(LCD_DATA_PORT_ID,LCD_DB4_PIN_ID,PIN_OUTPUT);
+	GPIO_setupPinDirectionInline(LCD_DATA_PORT_ID,LCD_DB5_PIN_ID,PIN_OUTPUT);
+	GPIO_setupPinDirectionInline(LCD_DATA_PORT_ID,LCD_DB6_PIN_ID,PIN_OUTPUT);
+	GPIO_setupPinDirectionInline(LCD_DATA_PORT_ID,LCD_DB7_PIN_ID,PIN_OUTPUT);
+#elif(LCD_DATA_BITS_MODE == 8)
+	GPIO_setupPortDirectionInline(LCD_DATA_PORT_ID, PORT_OUTPUT);
+#endif
+
+	return busy;
+}
+#endif
+
+/*
+ * Description :
+ * Transfer one byte to the LCD, as an instruction (RS=0) or as data (RS=1).
+ * The execution time is not waited here, the queue tick takes care of it.
+ */
+static void LCD_busTransfer(uint8 rs_value, uint8 value) {
+	GPIO_writePinInline(LCD_RS_PORT_ID, LCD_RS_PIN_ID, rs_value); /* Instruction Mode RS=0, Data Mode RS=1 */
+	/* Tas = 40ns is covered by one instruction time (125ns) */
+	GPIO_writePinInline(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_HIGH); /* Enable LCD E=1 */
+
+#if(LCD_DATA_BITS_MODE == 4)
+	/* High nibble on DB4..DB7 in one write */
+	GPIO_writePortMaskedInline(LCD_DATA_PORT_ID, LCD_DATA_NIBBLE_MASK,
+			(uint8)((value >> 4) << LCD_DB4_PIN_ID));
+
+	_delay_us(1); /* delay for processing Tpw = 230ns, Tdsw = 80ns */
+	GPIO_writePinInline(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_LOW); /* Disable LCD E=0 */
+	_delay_us(1); /* delay for processing Th = 10ns, tcycE = 500ns */
+	GPIO_writePinInline(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_HIGH); /* Enable LCD E=1 */
+
+	/* Low nibble */
+	GPIO_writePortMaskedInline(LCD_DATA_PORT_ID, LCD_DATA_NIBBLE_MASK,
+			(uint8)((value & 0x0F) << LCD_DB4_PIN_ID));
+
+	_delay_us(1); /* delay for processing Tpw = 230ns, Tdsw = 80ns */
+	GPIO_writePinInline(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_LOW); /* Disable LCD E=0 */
+
+#elif(LCD_DATA_BITS_MODE == 8)
+	GPIO_writePortInline(LCD_DATA_PORT_ID, value); /* out the required value to the data bus D0 --> D7 */
+	_delay_us(1); /* delay for processing Tpw = 230ns, Tdsw = 80ns */
+	GPIO_writePinInline(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_LOW); /* Disable LCD E=0 */
+#endif
+}
+
+#if (LCD_DATA_BITS_MODE == 4)
+/*
+ * Description :
+ * Send one nibble of the 4-bit init sequence on DB4..DB7. The LCD still runs
+ * the 8-bit interface and executes each nibble as a whole instruction.
+ */
+static void LCD_sendInitNibble(uint8 nibble) {
+	GPIO_writePinInline(LCD_RS_PORT_ID, LCD_RS_PIN_ID, LOGIC_LOW); /* Instruction Mode RS=0 */
+	GPIO_writePinInline(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_HIGH); /* Enable LCD E=1 */
+	GPIO_writePortMaskedInline(LCD_DATA_PORT_ID, LCD_DATA_NIBBLE_MASK,
+			(uint8)((nibble & 0x0F) << LCD_DB4_PIN_ID));
+	_delay_us(1); /* delay for processing Tpw = 230ns, Tdsw = 80ns */
+	GPIO_writePinInline(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_LOW); /* Disable LCD E=0 */
+}
+#endif
+
+/*
+ * Description :
+ * Timer0 compare match callback: send the next queued bus transaction once
+ * the LCD finished the previous one, stop Timer0 when the queue is empty.
+ */
+static void LCD_queueTask(void) {
+	uint8 tail = g_LCD_queueTail;
+
+	if (g_LCD_holdTicks != 0) {
+		g_LCD_holdTicks--; /* Previous instruction is still executing */
+		return;
+	}
+
+#if (LCD_USE_BUSY_FLAG == 1)
+	if (g_LCD_busyFlagReady && (tail != g_LCD_queueHead)) {
+		if (LCD_readBusyFlag() == LOGIC_HIGH) {
+			g_LCD_busyTicks++;
+			if (g_LCD_busyTicks < LCD_BUSY_FLAG_TIMEOUT) {
+				return; /* Try again on the next tick */
+			}
+			g_LCD_busyFlagReady = FALSE; /* No answer from the LCD, use fixed delays */
+		}
+		g_LCD_busyTicks = 0;
+	}
+#endif
+
+	if (tail == g_LCD_queueHead) {
+		/* Nothing left to send */
+		Timer_deInit(TIMER0_ID);
+		g_LCD_queueRunning = FALSE;
+		return;
+	}
+
+	LCD_busTransfer(g_LCD_queue[tail].rs_value, g_LCD_queue[tail].value);
+
+#if (LCD_USE_BUSY_FLAG == 1)
+	if (!g_LCD_busyFlagReady)
+#endif
+	{
+		/* Clear (0x01) and home (0x02/0x03) need longer than one tick */
+		if ((g_LCD_queue[tail].rs_value == LOGIC_LOW)
+				&& (g_LCD_queue[tail].value != 0)
+				&& ((g_LCD_queue[tail].value & 0xFC) == 0)) {
+			g_LCD_holdTicks = LCD_CLEAR_HOME_TIME_US / LCD_TICK_US;
+		}
+	}
+
+	g_LCD_queueTail = (tail + 1) & (LCD_QUEUE_SIZE - 1);
+}
+
+/*
+ * Description :
+ * Called while waiting for the queue. When interrupts are disabled (called
+ * from another interrupt) Timer0 cannot fire, so run its tick from here.
+ */
+static void LCD_serviceIfInterruptsDisabled(void) {
+	if (BIT_IS_CLEAR(LCD_SREG_REG, LCD_SREG_I_bitNum)) {
+		_delay_us(LCD_TICK_US);
+		LCD_queueTask();
+	}
+}
+
+/*
+ * Description :
+ * Add one bus transaction to the queue and make sure Timer0 drains it.
+ * Waits only if the queue is full.
+ */
+static void LCD_enqueue(uint8 rs_value, uint8 value) {
+	uint8 head = g_LCD_queueHead;
+	uint8 next = (head + 1) & (LCD_QUEUE_SIZE - 1);
+
+	while (next == g_LCD_queueTail) {
+		LCD_serviceIfInterruptsDisabled(); /* Queue is full */
+	}
+
+	g_LCD_queue[head].rs_value = rs_value;
+	g_LCD_queue[head].value = value;
+	g_LCD_queueHead = next;
+
+	/* Checked after the entry is added, so a stopping Timer0 can't miss it */
+	if (!g_LCD_queueRunning) {
+		g_LCD_queueRunning = TRUE;
+		Timer_setCallBack(LCD_queueTask, TIMER0_ID);
+		Timer_init(&g_LCD_timerConfig);
+	}
+}
+
+/*
+ * Description :
+ * Calculate the LCD DDRAM address of a specified row and column
+ */
+static uint8 LCD_cellAddress(uint8 row, uint8 col) {
+	uint8 lcd_memory_address = col;
+
+	switch (row) {
+	case 0:
+		lcd_memory_address = col;
+		break;
+	case 1:
+		lcd_memory_address = col + 0x40;
+		break;
+	case 2:
+		lcd_memory_address = col + LCD_NUM_COLS;
+		break;
+	case 3:
+		lcd_memory_address = col + 0x40 + LCD_NUM_COLS;
+		break;
+	}
+	return lcd_memory_address;
+}
 
 /*******************************************************************************
  *                      Functions Definitions                                  *
@@ -31,6 +307,10 @@ void LCD_init(void) {
 	/* Configure the direction for RS and E pins as output pins */
 	GPIO_setupPinDirection(LCD_RS_PORT_ID, LCD_RS_PIN_ID, PIN_OUTPUT);
 	GPIO_setupPinDirection(LCD_E_PORT_ID, LCD_E_PIN_ID, PIN_OUTPUT);
+#if (LCD_USE_BUSY_FLAG == 1)
+	GPIO_setupPinDirection(LCD_RW_PORT_ID, LCD_RW_PIN_ID, PIN_OUTPUT);
+	GPIO_writePin(LCD_RW_PORT_ID, LCD_RW_PIN_ID, LOGIC_LOW); /* Write mode RW=0 */
+#endif
 
 	_delay_ms(20); /* LCD Power ON delay always > 15ms */
 
@@ -41,9 +321,19 @@ void LCD_init(void) {
 	GPIO_setupPinDirection(LCD_DATA_PORT_ID,LCD_DB6_PIN_ID,PIN_OUTPUT);
 	GPIO_setupPinDirection(LCD_DATA_PORT_ID,LCD_DB7_PIN_ID,PIN_OUTPUT);
 
-	/* Send for 4 bit initialization of LCD  */
-	LCD_sendCommand(LCD_TWO_LINES_FOUR_BITS_MODE_INIT1);
-	LCD_sendCommand(LCD_TWO_LINES_FOUR_BITS_MODE_INIT2);
+	/*
+	 * Send for 4 bit initialization of LCD (initialization by instruction):
+	 * sent here rather than queued, the first two nibbles need far longer
+	 * than a queue tick
+	 */
+	LCD_sendInitNibble(LCD_TWO_LINES_FOUR_BITS_MODE_INIT1 >> 4);
+	_delay_us(LCD_INIT_WAIT1_US);
+	LCD_sendInitNibble(LCD_TWO_LINES_FOUR_BITS_MODE_INIT1);
+	_delay_us(LCD_INIT_WAIT2_US);
+	LCD_sendInitNibble(LCD_TWO_LINES_FOUR_BITS_MODE_INIT2 >> 4);
+	_delay_us(LCD_EXECUTION_TIME_US);
+	LCD_sendInitNibble(LCD_TWO_LINES_FOUR_BITS_MODE_INIT2); /* 4-bit interface from here */
+	_delay_us(LCD_EXECUTION_TIME_US);
 
 	/* use 2-lines LCD + 4-bits Data Mode + 5*7 dot display Mode */
 	LCD_sendCommand(LCD_TWO_LINES_FOUR_BITS_MODE);
@@ -57,86 +347,50 @@ void LCD_init(void) {
 
 #endif
 
+#if (LCD_USE_BUSY_FLAG == 1)
+	LCD_wait(); /* interface width must be set before the busy flag can be read */
+	g_LCD_busyFlagReady = TRUE;
+#endif
+
 	LCD_sendCommand(LCD_CURSOR_OFF); /* cursor off */
 	LCD_sendCommand(LCD_CLEAR_COMMAND); /* clear LCD at the beginning */
+	LCD_clearScreen(); /* start with an empty shadow framebuffer */
+	LCD_wait();
 }
 
 /*
  * Description :
- * Send the required command to the screen
+ * Queue the required command to the screen (bypasses the shadow framebuffer)
  */
 void LCD_sendCommand(uint8 command) {
-	GPIO_writePin(LCD_RS_PORT_ID, LCD_RS_PIN_ID, LOGIC_LOW); /* Instruction Mode RS=0 */
-	_delay_ms(1); /* delay for processing Tas = 50ns */
-	GPIO_writePin(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_HIGH); /* Enable LCD E=1 */
-	_delay_ms(1); /* delay for processing Tpw - Tdws = 190ns */
+	uint8 row, col;
 
-#if(LCD_DATA_BITS_MODE == 4)
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB4_PIN_ID,GET_BIT(command,4));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB5_PIN_ID,GET_BIT(command,5));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB6_PIN_ID,GET_BIT(command,6));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB7_PIN_ID,GET_BIT(command,7));
-
-	_delay_ms(1); /* delay for processing Tdsw = 100ns */
-	GPIO_writePin(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_LOW); /* Disable LCD E=0 */
-	_delay_ms(1); /* delay for processing Th = 13ns */
-	GPIO_writePin(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_HIGH); /* Enable LCD E=1 */
-	_delay_ms(1); /* delay for processing Tpw - Tdws = 190ns */
-
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB4_PIN_ID,GET_BIT(command,0));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB5_PIN_ID,GET_BIT(command,1));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB6_PIN_ID,GET_BIT(command,2));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB7_PIN_ID,GET_BIT(command,3));
-
-	_delay_ms(1); /* delay for processing Tdsw = 100ns */
-	GPIO_writePin(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_LOW); /* Disable LCD E=0 */
-	_delay_ms(1); /* delay for processing Th = 13ns */
+	LCD_enqueue(LOGIC_LOW, command);
 
-#elif(LCD_DATA_BITS_MODE == 8)
-	GPIO_writePort(LCD_DATA_PORT_ID, command); /* out the required command to the data bus D0 --> D7 */
-	_delay_ms(1); /* delay for processing Tdsw = 100ns */
-	GPIO_writePin(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_LOW); /* Disable LCD E=0 */
-	_delay_ms(1); /* delay for processing Th = 13ns */
-#endif
+	if (command == LCD_CLEAR_COMMAND) {
+		/* The LCD is blank now and its cursor is at home */
+		for (row = 0; row < LCD_NUM_ROWS; row++) {
+			for (col = 0; col < LCD_NUM_COLS; col++) {
+				g_LCD_glass[row][col] = ' ';
+			}
+		}
+		g_LCD_address = 0;
+	} else {
+		/* The command may have moved the LCD cursor */
+		g_LCD_address = LCD_ADDRESS_UNKNOWN;
+	}
 }
 
 /*
  * Description :
- * Display the required character on the screen
+ * Display the required character on the screen at the cursor position
+ * (drawn in the shadow framebuffer, shown on the next LCD_flush)
  */
 void LCD_displayCharacter(uint8 data) {
-	GPIO_writePin(LCD_RS_PORT_ID, LCD_RS_PIN_ID, LOGIC_HIGH); /* Data Mode RS=1 */
-	_delay_ms(1); /* delay for processing Tas = 50ns */
-	GPIO_writePin(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_HIGH); /* Enable LCD E=1 */
-	_delay_ms(1); /* delay for processing Tpw - Tdws = 190ns */
-
-#if(LCD_DATA_BITS_MODE == 4)
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB4_PIN_ID,GET_BIT(data,4));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB5_PIN_ID,GET_BIT(data,5));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB6_PIN_ID,GET_BIT(data,6));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB7_PIN_ID,GET_BIT(data,7));
-
-	_delay_ms(1); /* delay for processing Tdsw = 100ns */
-	GPIO_writePin(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_LOW); /* Disable LCD E=0 */
-	_delay_ms(1); /* delay for processing Th = 13ns */
-	GPIO_writePin(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_HIGH); /* Enable LCD E=1 */
-	_delay_ms(1); /* delay for processing Tpw - Tdws = 190ns */
-
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB4_PIN_ID,GET_BIT(data,0));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB5_PIN_ID,GET_BIT(data,1));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB6_PIN_ID,GET_BIT(data,2));
-	GPIO_writePin(LCD_DATA_PORT_ID,LCD_DB7_PIN_ID,GET_BIT(data,3));
-
-	_delay_ms(1); /* delay for processing Tdsw = 100ns */
-	GPIO_writePin(LCD_E_PORT_ID,LCD_E_PIN_ID,LOGIC_LOW); /* Disable LCD E=0 */
-	_delay_ms(1); /* delay for processing Th = 13ns */
-
-#elif(LCD_DATA_BITS_MODE == 8)
-	GPIO_writePort(LCD_DATA_PORT_ID, data); /* out the required command to the data bus D0 --> D7 */
-	_delay_ms(1); /* delay for processing Tdsw = 100ns */
-	GPIO_writePin(LCD_E_PORT_ID, LCD_E_PIN_ID, LOGIC_LOW); /* Disable LCD E=0 */
-	_delay_ms(1); /* delay for processing Th = 13ns */
-#endif
+	if ((g_LCD_row < LCD_NUM_ROWS) && (g_LCD_col < LCD_NUM_COLS)) {
+		g_LCD_frame[g_LCD_row][g_LCD_col] = data;
+		g_LCD_col++;
+	}
 }
 
 /*
@@ -160,28 +414,24 @@ void LCD_displayString(const char *Str) {
 
 /*
  * Description :
- * Move the cursor to a specified row and column index on the screen
+ * Display a string stored in flash, read one byte at a time with lpm
  */
-void LCD_moveCursor(uint8 row, uint8 col) {
-	uint8 lcd_memory_address;
+void LCD_displayString_P(const char *Str) {
+	uint8 data;
 
-	/* Calculate the required address in the LCD DDRAM */
-	switch (row) {
-	case 0:
-		lcd_memory_address = col;
-		break;
-	case 1:
-		lcd_memory_address = col + 0x40;
-		break;
-	case 2:
-		lcd_memory_address = col + 0x10;
-		break;
-	case 3:
-		lcd_memory_address = col + 0x50;
-		break;
+	while ((data = pgm_read_byte(Str)) != '\0') {
+		LCD_displayCharacter(data);
+		Str++;
 	}
-	/* Move the LCD cursor to this specific address */
-	LCD_sendCommand(lcd_memory_address | LCD_SET_CURSOR_LOCATION);
+}
+
+/*
+ * Description :
+ * Move the cursor to a specified row and column index on the screen
+ */
+void LCD_moveCursor(uint8 row, uint8 col) {
+	g_LCD_row = row;
+	g_LCD_col = col;
 }
 
 /*
@@ -193,6 +443,15 @@ void LCD_displayStringRowColumn(uint8 row, uint8 col, const char *Str) {
 	LCD_displayString(Str); /* display the string */
 }
 
+/*
+ * Description :
+ * Display a string stored in flash in a specified row and column index on the screen
+ */
+void LCD_displayStringRowColumn_P(uint8 row, uint8 col, const char *Str) {
+	LCD_moveCursor(row, col); /* go to to the required LCD position */
+	LCD_displayString_P(Str); /* display the string */
+}
+
 /*
  * Description :
  * Display the required decimal value on the screen
@@ -205,8 +464,55 @@ void LCD_intgerToString(int data) {
 
 /*
  * Description :
- * Send the clear screen command
+ * Clear the shadow framebuffer and move the cursor home
  */
 void LCD_clearScreen(void) {
-	LCD_sendCommand(LCD_CLEAR_COMMAND); /* Send clear display command */
+	uint8 row, col;
+
+	for (row = 0; row < LCD_NUM_ROWS; row++) {
+		for (col = 0; col < LCD_NUM_COLS; col++) {
+			g_LCD_frame[row][col] = ' ';
+		}
+	}
+	LCD_moveCursor(0, 0);
+}
+
+/*
+ * Description :
+ * Queue the changed cells of the shadow framebuffer to the LCD.
+ * The LCD auto-increments its address after each character, so the cursor
+ * is moved only at the start of each run of changed cells.
+ */
+void LCD_flush(void) {
+	uint8 row, col, address;
+
+	for (row = 0; row < LCD_NUM_ROWS; row++) {
+		for (col = 0; col < LCD_NUM_COLS; col++) {
+			if (g_LCD_frame[row][col] != g_LCD_glass[row][col]) {
+				address = LCD_cellAddress(row, col);
+				if (address != g_LCD_address) {
+					LCD_enqueue(LOGIC_LOW, address | LCD_SET_CURSOR_LOCATION);
+				}
+				LCD_enqueue(LOGIC_HIGH, g_LCD_frame[row][col]);
+				g_LCD_glass[row][col] = g_LCD_frame[row][col];
+				g_LCD_address = address + 1;
+			}
+		}
+	}
+
+	/* From interrupt context Timer0 can't drain the queue, send it now */
+	while (g_LCD_queueRunning && BIT_IS_CLEAR(LCD_SREG_REG, LCD_SREG_I_bitNum)) {
+		LCD_serviceIfInterruptsDisabled();
+	}
+}
+
+/*
+ * Description :
+ * Flush the shadow framebuffer and wait until the queue is fully sent
+ */
+void LCD_wait(void) {
+	LCD_flush();
+	while (g_LCD_queueRunning) {
+		LCD_serviceIfInterruptsDisabled();
+	}
 }
@@ -20,7 +20,9 @@
  *******************************************************************************/
 
 /* LCD Data bits mode configuration, its value should be 4 or 8*/
+#ifndef LCD_DATA_BITS_MODE
 #define LCD_DATA_BITS_MODE 8
+#endif
 
 #if((LCD_DATA_BITS_MODE != 4) && (LCD_DATA_BITS_MODE != 8))
 
@@ -28,6 +30,16 @@
 
 #endif
 
+/* LCD geometry: 2x16 or 4x20 (4x16 also works) */
+#define LCD_NUM_ROWS                   2
+#define LCD_NUM_COLS                   16
+
+#if((LCD_NUM_ROWS != 2) && (LCD_NUM_ROWS != 4))
+
+#error "Number of LCD rows should be equal to 2 or 4"
+
+#endif
+
 /* LCD HW Ports and Pins Ids */
 #define LCD_RS_PORT_ID                 PORTC_ID
 #define LCD_RS_PIN_ID                  PIN0_ID
@@ -35,6 +47,38 @@
 #define LCD_E_PORT_ID                  PORTC_ID
 #define LCD_E_PIN_ID                   PIN1_ID
 
+/*
+ * Busy flag polling: set to 1 when the LCD RW pin is wired to the MCU,
+ * keep 0 when RW is tied to GND (fixed datasheet delays are used then)
+ */
+#ifndef LCD_USE_BUSY_FLAG
+#define LCD_USE_BUSY_FLAG              0
+#endif
+
+#if (LCD_USE_BUSY_FLAG == 1)
+
+#define LCD_RW_PORT_ID                 PORTC_ID
+#define LCD_RW_PIN_ID                  PIN2_ID
+
+/* Busy ticks before giving up and falling back to fixed delays (~25ms) */
+#define LCD_BUSY_FLAG_TIMEOUT          500
+
+#endif
+
+/* LCD command queue drained by the Timer0 compare interrupt (power of two, max 128) */
+#define LCD_QUEUE_SIZE                 32
+#define LCD_TICK_US                    50    /* one bus transaction per tick, >= LCD_EXECUTION_TIME_US */
+
+#if ((LCD_QUEUE_SIZE & (LCD_QUEUE_SIZE - 1)) != 0) || (LCD_QUEUE_SIZE > 128)
+#error "LCD_QUEUE_SIZE should be a power of two and not more than 128"
+#endif
+
+/* HD44780 execution times (datasheet, fosc = 270KHz) */
+#define LCD_EXECUTION_TIME_US          40    /* most instructions 37us, data write 37us + tADD 4us */
+#define LCD_CLEAR_HOME_TIME_US         1600  /* clear display and return home 1.52ms */
+#define LCD_INIT_WAIT1_US              4500  /* 4-bit init by instruction, after the first 0x3: > 4.1ms */
+#define LCD_INIT_WAIT2_US              150   /* and after the second 0x3: > 100us */
+
 #define LCD_DATA_PORT_ID               PORTA_ID
 
 #if (LCD_DATA_BITS_MODE == 4)
@@ -44,6 +88,10 @@
 #define LCD_DB6_PIN_ID                 PIN5_ID
 #define LCD_DB7_PIN_ID                 PIN6_ID
 
+#elif (LCD_DATA_BITS_MODE == 8)
+
+#define LCD_DB7_PIN_ID                 PIN7_ID
+
 #endif
 
 /* LCD Commands */
@@ -71,22 +119,30 @@ void LCD_init(void);
 
 /*
  * Description :
- * Send the required command to the screen
+ * Queue the required command to the screen (bypasses the shadow framebuffer)
  */
 void LCD_sendCommand(uint8 command);
 
 /*
  * Description :
- * Display the required character on the screen
+ * Display the required character on the screen at the cursor position
+ * (drawn in the shadow framebuffer, shown on the next LCD_flush)
  */
 void LCD_displayCharacter(uint8 data);
 
 /*
  * Description :
  * Display the required string on the screen
+ * (drawn in the shadow framebuffer, shown on the next LCD_flush)
  */
 void LCD_displayString(const char *Str);
 
+/*
+ * Description :
+ * Same as LCD_displayString for a string stored in flash (PROGMEM, PSTR)
+ */
+void LCD_displayString_P(const char *Str);
+
 /*
  * Description :
  * Move the cursor to a specified row and column index on the screen
@@ -96,19 +152,42 @@ void LCD_moveCursor(uint8 row, uint8 col);
 /*
  * Description :
  * Display the required string in a specified row and column index on the screen
+ * (drawn in the shadow framebuffer, shown on the next LCD_flush)
  */
 void LCD_displayStringRowColumn(uint8 row, uint8 col, const char *Str);
 
+/*
+ * Description :
+ * Same as LCD_displayStringRowColumn for a string stored in flash (PROGMEM, PSTR)
+ */
+void LCD_displayStringRowColumn_P(uint8 row, uint8 col, const char *Str);
+
 /*
  * Description :
  * Display the required decimal value on the screen
+ * (drawn in the shadow framebuffer, shown on the next LCD_flush)
  */
 void LCD_intgerToString(int data);
 
 /*
  * Description :
- * Send the clear screen command
+ * Clear the shadow framebuffer and move the cursor home (shown on the next LCD_flush)
  */
 void LCD_clearScreen(void);
 
+/*
+ * Description :
+ * Queue to the LCD only the cells of the shadow framebuffer that differ from
+ * what is displayed, moving the LCD cursor only when a run of changed cells starts.
+ * Returns right away, Timer0 sends the queue in the background (waits only if
+ * the queue is full).
+ */
+void LCD_flush(void);
+
+/*
+ * Description :
+ * Flush the shadow framebuffer and wait until everything is sent to the LCD
+ */
+void LCD_wait(void);
+
 #endif /* LCD_H_ */
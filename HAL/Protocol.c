@@ -0,0 +1,149 @@
+/******************************************************************************
+ *
+ * Module: PROTOCOL
+ *
+ * File Name: Protocol.c
+ *
+ * Description: Source file for the framed HMI <-> Control link protocol
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "Protocol.h"
+#include "Protocol_parser.h"
+#include "../MCAL_Drivers/UART.h"
+#include "../MCAL_Drivers/Timer.h"
+#include "../imp_files/common_macros.h"
+
+/*******************************************************************************
+ *                      Private Types and Variables                            *
+ *******************************************************************************/
+
+static Protocol_ParserType g_rxParser; /* Frame under reception */
+static uint8 g_txSequence = 0;        /* Sequence number of the next sent frame */
+static Protocol_StatsType g_stats;    /* Frame counters */
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+/*
+ * Description :
+ * Feed one received byte to the parser and count the dropped frames.
+ * Returns TRUE when this byte completes a frame with a valid CRC.
+ */
+static boolean PROTOCOL_feedByte(uint8 data)
+{
+	switch(PROTOCOL_parseByte(&g_rxParser, data, Timer_nowMs()))
+	{
+	case PROTOCOL_PARSE_FRAME:
+		COUNT_SATURATED(g_stats.frames_received);
+		return TRUE;
+	case PROTOCOL_PARSE_CRC_ERROR:
+		COUNT_SATURATED(g_stats.crc_errors);
+		break;
+	case PROTOCOL_PARSE_CUT:
+		COUNT_SATURATED(g_stats.cut_frames);
+		break;
+	default:
+		break;
+	}
+	return FALSE;
+}
+
+/*
+ * Description :
+ * Send one frame with the given sequence number.
+ */
+static void PROTOCOL_transmit(uint8 command, uint8 sequence, const uint8 *payload, uint8 length)
+{
+	uint8 i;
+	uint8 crc = 0;
+
+	if(length > PROTOCOL_MAX_PAYLOAD)
+	{
+		length = PROTOCOL_MAX_PAYLOAD;
+	}
+
+	UART_sendByte(PROTOCOL_START_BYTE);
+	UART_sendByte(command);
+	crc = PROTOCOL_crc8Update(crc, command);
+	UART_sendByte(length);
+	crc = PROTOCOL_crc8Update(crc, length);
+	UART_sendByte(sequence);
+	crc = PROTOCOL_crc8Update(crc, sequence);
+	for(i = 0 ; i < length ; i++)
+	{
+		UART_sendByte(payload[i]);
+		crc = PROTOCOL_crc8Update(crc, payload[i]);
+	}
+	UART_sendByte(crc);
+	COUNT_SATURATED(g_stats.frames_sent);
+}
+
+/*
+ * Description :
+ * Copy the frame completed by the parser to the caller's frame.
+ */
+static void PROTOCOL_copyFrame(Protocol_FrameType *frame)
+{
+	uint8 i;
+	frame->command = g_rxParser.frame.command;
+	frame->length = g_rxParser.frame.length;
+	frame->sequence = g_rxParser.frame.sequence;
+	for(i = 0 ; i < g_rxParser.frame.length ; i++)
+	{
+		frame->payload[i] = g_rxParser.frame.payload[i];
+	}
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+void PROTOCOL_init(void)
+{
+	PROTOCOL_parserReset(&g_rxParser);
+	g_txSequence = 0;
+	PROTOCOL_clearStats();
+}
+
+uint8 PROTOCOL_sendFrame(uint8 command, const uint8 *payload, uint8 length)
+{
+	uint8 sequence = g_txSequence++;
+
+	PROTOCOL_transmit(command, sequence, payload, length);
+	return sequence;
+}
+
+void PROTOCOL_sendResponse(const Protocol_FrameType *request, const uint8 *payload, uint8 length)
+{
+	PROTOCOL_transmit(request->command, request->sequence, payload, length);
+}
+
+boolean PROTOCOL_pollFrame(Protocol_FrameType *frame)
+{
+	uint8 data;
+
+	while(UART_tryReceive(&data))
+	{
+		if(PROTOCOL_feedByte(data))
+		{
+			PROTOCOL_copyFrame(frame);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+void PROTOCOL_getStats(Protocol_StatsType *stats)
+{
+	*stats = g_stats;
+}
+
+void PROTOCOL_clearStats(void)
+{
+	static const Protocol_StatsType zero = { 0 };
+	g_stats = zero;
+}
@@ -0,0 +1,98 @@
+/******************************************************************************
+ *
+ * Module: PROTOCOL
+ *
+ * File Name: Protocol.h
+ *
+ * Description: Header file for the framed HMI <-> Control link protocol
+ *
+ * Frame layout on the UART:
+ *   | START | COMMAND | LENGTH | SEQUENCE | PAYLOAD (LENGTH bytes) | CRC-8 |
+ * The CRC-8 (polynomial 0x07) covers COMMAND, LENGTH, SEQUENCE and PAYLOAD.
+ * A response frame carries the same COMMAND and SEQUENCE as its request.
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include "../imp_files/std_types.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+
+#define PROTOCOL_START_BYTE      0x7E  /* Marks the beginning of every frame */
+#define PROTOCOL_MAX_PAYLOAD     20    /* Largest payload carried by one frame (LINK_STATS response) */
+#define PROTOCOL_CRC8_POLYNOMIAL 0x07  /* CRC-8 polynomial x^8 + x^2 + x + 1 */
+#define PROTOCOL_BYTE_TIMEOUT_MS 20    /* Longest gap inside a frame, a longer one drops the partial frame */
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+
+/* Frame counters since PROTOCOL_init or PROTOCOL_clearStats, each saturates at 0xFFFF */
+typedef struct {
+	uint16 frames_received;  /* Frames with a valid CRC */
+	uint16 frames_sent;      /* Frames sent, requests and responses */
+	uint16 crc_errors;       /* Frames dropped for a wrong CRC */
+	uint16 cut_frames;       /* Partial frames dropped for a bad length or a gap (lost byte) */
+} Protocol_StatsType;
+
+typedef struct {
+	uint8 command;                        /* Command ID */
+	uint8 length;                         /* Number of payload bytes */
+	uint8 sequence;                       /* Sequence number */
+	uint8 payload[PROTOCOL_MAX_PAYLOAD];  /* Payload bytes (raw binary) */
+} Protocol_FrameType;
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+
+/*
+ * Description :
+ * Reset the frame parser and the sequence counter.
+ * UART_init should be called before.
+ */
+void PROTOCOL_init(void);
+
+/*
+ * Description :
+ * Send one frame with the given command and payload (length bytes, may be 0).
+ * Returns the sequence number used for this frame.
+ */
+uint8 PROTOCOL_sendFrame(uint8 command, const uint8 *payload, uint8 length);
+
+/*
+ * Description :
+ * Send the response to a request frame received from the other side: same
+ * command and sequence number as the request.
+ */
+void PROTOCOL_sendResponse(const Protocol_FrameType *request, const uint8 *payload, uint8 length);
+
+/*
+ * Description :
+ * Non-blocking receive: feed the parser with the bytes waiting in the UART
+ * RX buffer. Returns TRUE and fills frame once a complete frame with a valid
+ * CRC is received. Corrupted frames, and frames cut by a gap longer than
+ * PROTOCOL_BYTE_TIMEOUT_MS (lost byte), are dropped and the parser
+ * resynchronizes on the next start byte.
+ */
+boolean PROTOCOL_pollFrame(Protocol_FrameType *frame);
+
+/*
+ * Description :
+ * Copy the frame counters to stats.
+ */
+void PROTOCOL_getStats(Protocol_StatsType *stats);
+
+/*
+ * Description :
+ * Start the frame counters again from 0.
+ */
+void PROTOCOL_clearStats(void);
+
+#endif /* PROTOCOL_H_ */
@@ -0,0 +1,105 @@
+/******************************************************************************
+ *
+ * Module: PROTOCOL
+ *
+ * File Name: Protocol_parser.c
+ *
+ * Description: Source file for the frame parser and CRC-8 of the HMI <-> Control
+ *              link protocol
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "Protocol_parser.h"
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+uint8 PROTOCOL_crc8Update(uint8 crc, uint8 data)
+{
+	uint8 bit;
+	crc ^= data;
+	for(bit = 0 ; bit < 8 ; bit++)
+	{
+		if(crc & 0x80)
+		{
+			crc = (uint8)((crc << 1) ^ PROTOCOL_CRC8_POLYNOMIAL);
+		}
+		else
+		{
+			crc <<= 1;
+		}
+	}
+	return crc;
+}
+
+void PROTOCOL_parserReset(Protocol_ParserType *parser)
+{
+	parser->state = PROTOCOL_WAIT_START;
+	parser->index = 0;
+}
+
+Protocol_ParseResultType PROTOCOL_parseByte(Protocol_ParserType *parser, uint8 data, uint32 now_ms)
+{
+	Protocol_ParseResultType result = PROTOCOL_PARSE_BUSY;
+
+	if((parser->state != PROTOCOL_WAIT_START) && ((now_ms - parser->last_ms) > PROTOCOL_BYTE_TIMEOUT_MS))
+	{
+		/* This byte can then only be a start byte: the result stays PROTOCOL_PARSE_CUT */
+		parser->state = PROTOCOL_WAIT_START;
+		result = PROTOCOL_PARSE_CUT;
+	}
+	parser->last_ms = now_ms;
+
+	switch(parser->state)
+	{
+	case PROTOCOL_WAIT_START:
+		if(data == PROTOCOL_START_BYTE)
+		{
+			parser->crc = 0;
+			parser->state = PROTOCOL_WAIT_COMMAND;
+		}
+		break;
+	case PROTOCOL_WAIT_COMMAND:
+		parser->frame.command = data;
+		parser->crc = PROTOCOL_crc8Update(parser->crc, data);
+		parser->state = PROTOCOL_WAIT_LENGTH;
+		break;
+	case PROTOCOL_WAIT_LENGTH:
+		if(data > PROTOCOL_MAX_PAYLOAD)
+		{
+			/* Can't be a valid frame, look for the next start byte */
+			parser->state = PROTOCOL_WAIT_START;
+			result = PROTOCOL_PARSE_CUT;
+		}
+		else
+		{
+			parser->frame.length = data;
+			parser->crc = PROTOCOL_crc8Update(parser->crc, data);
+			parser->state = PROTOCOL_WAIT_SEQUENCE;
+		}
+		break;
+	case PROTOCOL_WAIT_SEQUENCE:
+		parser->frame.sequence = data;
+		parser->crc = PROTOCOL_crc8Update(parser->crc, data);
+		parser->index = 0;
+		parser->state = (parser->frame.length == 0) ? PROTOCOL_WAIT_CRC : PROTOCOL_WAIT_PAYLOAD;
+		break;
+	case PROTOCOL_WAIT_PAYLOAD:
+		parser->frame.payload[parser->index] = data;
+		parser->crc = PROTOCOL_crc8Update(parser->crc, data);
+		parser->index++;
+		if(parser->index == parser->frame.length)
+		{
+			parser->state = PROTOCOL_WAIT_CRC;
+		}
+		break;
+	case PROTOCOL_WAIT_CRC:
+		parser->state = PROTOCOL_WAIT_START;
+		result = (data == parser->crc) ? PROTOCOL_PARSE_FRAME : PROTOCOL_PARSE_CRC_ERROR;
+		break;
+	}
+	return result;
+}
@@ -0,0 +1,77 @@
+/******************************************************************************
+ *
+ * Module: PROTOCOL
+ *
+ * File Name: Protocol_parser.h
+ *
+ * Description: Header file for the frame parser and CRC-8 of the HMI <-> Control
+ *              link protocol, without any UART or timer dependency
+ *
+ * The parser is shared by Protocol.c and the Control ECU stand-in of the host
+ * simulation (control_emu.c), so both sides read frames the same way.
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef PROTOCOL_PARSER_H_
+#define PROTOCOL_PARSER_H_
+
+#include "Protocol.h"
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+
+/* Receive parser states, one per field of the frame */
+typedef enum {
+	PROTOCOL_WAIT_START,
+	PROTOCOL_WAIT_COMMAND,
+	PROTOCOL_WAIT_LENGTH,
+	PROTOCOL_WAIT_SEQUENCE,
+	PROTOCOL_WAIT_PAYLOAD,
+	PROTOCOL_WAIT_CRC
+} Protocol_RxStateType;
+
+/* Outcome of one byte given to the parser */
+typedef enum {
+	PROTOCOL_PARSE_BUSY,       /* No complete frame yet */
+	PROTOCOL_PARSE_FRAME,      /* The byte completed a frame with a valid CRC */
+	PROTOCOL_PARSE_CRC_ERROR,  /* The byte completed a frame with a wrong CRC, dropped */
+	PROTOCOL_PARSE_CUT         /* A partial frame was dropped (bad length or gap) */
+} Protocol_ParseResultType;
+
+typedef struct {
+	Protocol_RxStateType state;
+	Protocol_FrameType frame;  /* Frame under reception, complete after PROTOCOL_PARSE_FRAME */
+	uint8 index;               /* Payload bytes received so far */
+	uint8 crc;                 /* Running CRC of the frame under reception */
+	uint32 last_ms;            /* Time the last byte was taken by the parser */
+} Protocol_ParserType;
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+
+/*
+ * Description :
+ * Update a CRC-8 value with one more byte (bitwise, no lookup table).
+ */
+uint8 PROTOCOL_crc8Update(uint8 crc, uint8 data);
+
+/*
+ * Description :
+ * Drop any partial frame, the parser waits for the next start byte.
+ */
+void PROTOCOL_parserReset(Protocol_ParserType *parser);
+
+/*
+ * Description :
+ * Feed one received byte, taken at now_ms, to the parser. A partial frame
+ * whose previous byte is older than PROTOCOL_BYTE_TIMEOUT_MS is dropped first:
+ * a byte of it was lost, and without this the parser would take the start of
+ * the next frame as payload and lose that frame too.
+ */
+Protocol_ParseResultType PROTOCOL_parseByte(Protocol_ParserType *parser, uint8 data, uint32 now_ms);
+
+#endif /* PROTOCOL_PARSER_H_ */
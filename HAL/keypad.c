@@ -11,160 +11,235 @@
  *******************************************************************************/
 #include "keypad.h"
 #include "../MCAL_Drivers/gpio.h"
+#include "../MCAL_Drivers/Timer.h"
+#include "../imp_files/common_macros.h"
 #include <util/delay.h>
+#include <avr/cpufunc.h>
+#include <avr/pgmspace.h>
 
 /*******************************************************************************
  *                      Functions Prototypes(Private)                          *
  *******************************************************************************/
 
-#ifndef STANDARD_KEYPAD
-
-#if (KEYPAD_NUM_COLS == 3)
-/*
- * Function responsible for mapping the switch number in the keypad to
- * its corresponding functional number in the proteus for 4x3 keypad
- */
-static uint8 KEYPAD_4x3_adjustKeyNumber(uint8 button_number);
-#elif (KEYPAD_NUM_COLS == 4)
 /*
- * Function responsible for mapping the switch number in the keypad to
- * its corresponding functional number in the proteus for 4x4 keypad
+ * Timer2 compare match callback: scan the whole keypad once and debounce
  */
-static uint8 KEYPAD_4x4_adjustKeyNumber(uint8 button_number);
+static void KEYPAD_scanTask(void);
+
+#if (KEYPAD_NUM_OF_KEYS > 32)
+#error "Keypad debounce supports up to 32 keys"
+#endif
+
+#if ((KEYPAD_FIRST_ROW_PIN_ID + KEYPAD_NUM_ROWS > 8) || (KEYPAD_FIRST_COL_PIN_ID + KEYPAD_NUM_COLS > 8))
+#error "The keypad rows and columns should each fit in one port"
+#endif
+
+/* Timer2 in CTC mode, interrupt every KEYPAD_SCAN_PERIOD_MS */
+#define KEYPAD_SCAN_PERIOD_US    (KEYPAD_SCAN_PERIOD_MS * 1000UL)
+#define KEYPAD_SCAN_PRESCALER    TIMER_PRESCALER(KEYPAD_SCAN_PERIOD_US, 256)
+
+#if (KEYPAD_SCAN_PRESCALER == 0) || (TIMER_ERROR(KEYPAD_SCAN_PERIOD_US, KEYPAD_SCAN_PRESCALER) > TIMER_MAX_PERIOD_ERROR)
+#error "KEYPAD_SCAN_PERIOD_MS can't be produced by Timer2 at this F_CPU"
+#endif
+
+/*******************************************************************************
+ *                      Private Variables                                      *
+ *******************************************************************************/
+
+/* Status register, used to know if the blocking calls run with interrupts disabled */
+#define KEYPAD_SREG_REG (*(volatile uint8*)IO_ADDRESS(0x5F))
+#define KEYPAD_SREG_I_bitNum 7
+
+static const Timer_ConfigType g_KEYPAD_timerConfig = { 0,
+		(uint16)TIMER_COMPARE(KEYPAD_SCAN_PERIOD_US, KEYPAD_SCAN_PRESCALER), TIMER2_ID,
+		TIMER_CLOCK(KEYPAD_SCAN_PRESCALER), CTC_0_OR_2 };
+
+/* Row pin in the row port registers, column pins in the column port registers */
+#define KEYPAD_ROW_BIT(row)   ((uint8)(1 << (KEYPAD_FIRST_ROW_PIN_ID + (row))))
+#define KEYPAD_COLS_MASK      ((uint8)((1 << KEYPAD_NUM_COLS) - 1))
+
+/* One bit per key, row by row: the smallest type that holds all the keys */
+#if (KEYPAD_NUM_OF_KEYS > 16)
+typedef uint32 KEYPAD_KeysType;
+#else
+typedef uint16 KEYPAD_KeysType;
+#endif
+
+/* First set bit of a row's column bits: the next column of a row to debounce */
+#if (KEYPAD_NUM_COLS > 4)
+static const uint8 g_KEYPAD_firstColumn[32] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+		4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
+#else
+static const uint8 g_KEYPAD_firstColumn[16] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
 #endif
 
-#endif /* STANDARD_KEYPAD */
+/* Value of each key of the fitted model, indexed by the scanned key number */
+static const uint8 g_KEYPAD_keyMap[KEYPAD_NUM_OF_KEYS] PROGMEM = KEYPAD_KEY_MAP;
+
+/* Debounce state of each key: accepted level (one bit per key) and change counter */
+static KEYPAD_KeysType g_KEYPAD_stable = 0;
+static KEYPAD_KeysType g_KEYPAD_counting = 0; /* Keys with a non zero change counter */
+static uint8 g_KEYPAD_count[KEYPAD_NUM_OF_KEYS];
+
+/* Key events FIFO, written by the scan interrupt */
+static volatile KEYPAD_EventType g_KEYPAD_events[KEYPAD_EVENT_QUEUE_SIZE];
+static volatile uint8 g_KEYPAD_eventHead = 0; /* Next free entry (owned by the interrupt) */
+static volatile uint8 g_KEYPAD_eventTail = 0; /* Oldest event (owned by the application) */
 
 /*******************************************************************************
  *                      Functions Definitions                                  *
  *******************************************************************************/
 
+void KEYPAD_init(void)
+{
+	uint8 i;
+
+	/*
+	 * All rows and columns are inputs, the scan drives one row at a time by
+	 * making it an output: the row levels are set once here
+	 */
+	for(i=0 ; i<KEYPAD_NUM_ROWS ; i++)
+	{
+		GPIO_setupPinDirection(KEYPAD_ROW_PORT_ID, KEYPAD_FIRST_ROW_PIN_ID+i, PIN_INPUT);
+		GPIO_writePin(KEYPAD_ROW_PORT_ID, KEYPAD_FIRST_ROW_PIN_ID+i, KEYPAD_BUTTON_PRESSED);
+	}
+	for(i=0 ; i<KEYPAD_NUM_COLS ; i++)
+	{
+		GPIO_setupPinDirection(KEYPAD_COL_PORT_ID, KEYPAD_FIRST_COL_PIN_ID+i, PIN_INPUT);
+	}
+	for(i=0 ; i<KEYPAD_NUM_OF_KEYS ; i++)
+	{
+		g_KEYPAD_count[i] = 0;
+	}
+
+	g_KEYPAD_stable = 0;
+	g_KEYPAD_counting = 0;
+	g_KEYPAD_eventHead = g_KEYPAD_eventTail = 0;
+
+	Timer_setCallBack(KEYPAD_scanTask, TIMER2_ID);
+	Timer_init(&g_KEYPAD_timerConfig);
+}
+
+boolean KEYPAD_pollEvent(KEYPAD_EventType *event)
+{
+	uint8 tail = g_KEYPAD_eventTail;
+
+	if(tail == g_KEYPAD_eventHead)
+	{
+		return FALSE; /* No key event */
+	}
+
+	event->key = g_KEYPAD_events[tail].key;
+	event->kind = g_KEYPAD_events[tail].kind;
+	g_KEYPAD_eventTail = (tail + 1) & (KEYPAD_EVENT_QUEUE_SIZE - 1);
+
+	return TRUE;
+}
+
+boolean KEYPAD_eventPending(void)
+{
+	return (g_KEYPAD_eventTail != g_KEYPAD_eventHead);
+}
+
 uint8 KEYPAD_getPressedKey(void)
 {
-	uint8 col,row;
-	GPIO_setupPinDirection(KEYPAD_ROW_PORT_ID, KEYPAD_FIRST_ROW_PIN_ID, PIN_INPUT);
-	GPIO_setupPinDirection(KEYPAD_ROW_PORT_ID, KEYPAD_FIRST_ROW_PIN_ID+1, PIN_INPUT);
-	GPIO_setupPinDirection(KEYPAD_ROW_PORT_ID, KEYPAD_FIRST_ROW_PIN_ID+2, PIN_INPUT);
-	GPIO_setupPinDirection(KEYPAD_ROW_PORT_ID, KEYPAD_FIRST_ROW_PIN_ID+3, PIN_INPUT);
-
-	GPIO_setupPinDirection(KEYPAD_COL_PORT_ID, KEYPAD_FIRST_COL_PIN_ID, PIN_INPUT);
-	GPIO_setupPinDirection(KEYPAD_COL_PORT_ID, KEYPAD_FIRST_COL_PIN_ID+1, PIN_INPUT);
-	GPIO_setupPinDirection(KEYPAD_COL_PORT_ID, KEYPAD_FIRST_COL_PIN_ID+2, PIN_INPUT);
-#if(KEYPAD_NUM_COLS == 4)
-	GPIO_setupPinDirection(KEYPAD_COL_PORT_ID, KEYPAD_FIRST_COL_PIN_ID+3, PIN_INPUT);
-#endif
+	KEYPAD_EventType event;
+
 	while(1)
 	{
-		for(row=0 ; row<KEYPAD_NUM_ROWS ; row++) /* loop for rows */
+		if(KEYPAD_pollEvent(&event))
 		{
-			/* 
-			 * Each time setup the direction for all keypad port as input pins,
-			 * except this row will be output pin
-			 */
-			GPIO_setupPinDirection(KEYPAD_ROW_PORT_ID,KEYPAD_FIRST_ROW_PIN_ID+row,PIN_OUTPUT);
-
-			/* Set/Clear the row output pin */
-			GPIO_writePin(KEYPAD_ROW_PORT_ID, KEYPAD_FIRST_ROW_PIN_ID+row, KEYPAD_BUTTON_PRESSED);
-
-			for(col=0 ; col<KEYPAD_NUM_COLS ; col++) /* loop for columns */
+			if(event.kind == KEYPAD_KEY_PRESSED)
 			{
-				/* Check if the switch is pressed in this column */
-				if(GPIO_readPin(KEYPAD_COL_PORT_ID,KEYPAD_FIRST_COL_PIN_ID+col) == KEYPAD_BUTTON_PRESSED)
-				{
-					#if (KEYPAD_NUM_COLS == 3)
-						#ifdef STANDARD_KEYPAD
-							return ((row*KEYPAD_NUM_COLS)+col+1);
-						#else
-							return KEYPAD_4x3_adjustKeyNumber((row*KEYPAD_NUM_COLS)+col+1);
-						#endif
-					#elif (KEYPAD_NUM_COLS == 4)
-						#ifdef STANDARD_KEYPAD
-							return ((row*KEYPAD_NUM_COLS)+col+1);
-						#else
-							return KEYPAD_4x4_adjustKeyNumber((row*KEYPAD_NUM_COLS)+col+1);
-						#endif
-					#endif
-				}
+				return event.key;
 			}
-			GPIO_setupPinDirection(KEYPAD_ROW_PORT_ID,KEYPAD_FIRST_ROW_PIN_ID+row,PIN_INPUT);
-			_delay_ms(5); /* Add small delay to fix CPU load issue in proteus */
 		}
-	}	
+		else if(BIT_IS_CLEAR(KEYPAD_SREG_REG, KEYPAD_SREG_I_bitNum))
+		{
+			/* Called from interrupt context, Timer2 can't fire: scan from here */
+			_delay_ms(KEYPAD_SCAN_PERIOD_MS);
+			KEYPAD_scanTask();
+		}
+	}
 }
 
-#ifndef STANDARD_KEYPAD
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
 
-#if (KEYPAD_NUM_COLS == 3)
 /*
  * Description :
- * Update the keypad pressed button value with the correct one in keypad 4x3 shape
+ * Accept a key level change once it was seen in KEYPAD_DEBOUNCE_SCANS
+ * consecutive scans, then push a press/release event into the FIFO.
  */
-static uint8 KEYPAD_4x3_adjustKeyNumber(uint8 button_number)
+static void KEYPAD_debounce(uint8 index, uint8 pressed)
 {
-	uint8 keypad_button = 0;
-	switch(button_number)
+	KEYPAD_KeysType bit = (KEYPAD_KeysType)1 << index;
+	uint8 next;
+
+	if(pressed == ((g_KEYPAD_stable & bit) != 0))
 	{
-		case 10: keypad_button = '*'; // ASCII Code of *
-				 break;
-		case 11: keypad_button = 0;
-				 break;		
-		case 12: keypad_button = '#'; // ASCII Code of #
-				 break;
-		default: keypad_button = button_number;
-				break;
+		g_KEYPAD_count[index] = 0; /* A bounce that went back */
+		g_KEYPAD_counting &= ~bit;
+		return;
 	}
-	return keypad_button;
-} 
 
-#elif (KEYPAD_NUM_COLS == 4)
+	g_KEYPAD_count[index]++;
+	if(g_KEYPAD_count[index] < KEYPAD_DEBOUNCE_SCANS)
+	{
+		g_KEYPAD_counting |= bit;
+		return; /* Not stable yet */
+	}
+
+	g_KEYPAD_count[index] = 0;
+	g_KEYPAD_counting &= ~bit;
+	g_KEYPAD_stable ^= bit;
+
+	next = (g_KEYPAD_eventHead + 1) & (KEYPAD_EVENT_QUEUE_SIZE - 1);
+	if(next != g_KEYPAD_eventTail) /* Drop the event if the FIFO is full */
+	{
+		g_KEYPAD_events[g_KEYPAD_eventHead].key = pgm_read_byte(&g_KEYPAD_keyMap[index]);
+		g_KEYPAD_events[g_KEYPAD_eventHead].kind = pressed ? KEYPAD_KEY_PRESSED : KEYPAD_KEY_RELEASED;
+		g_KEYPAD_eventHead = next;
+	}
+}
 
 /*
  * Description :
- * Update the keypad pressed button value with the correct one in keypad 4x4 shape
+ * Drive each row in turn and sample all its columns with one PIN read, then
+ * debounce only the keys that changed or are still settling: an idle scan of
+ * the whole keypad is a few instructions per row. After a row with a key
+ * down, the next row waits for the pulled columns to come back.
  */
-static uint8 KEYPAD_4x4_adjustKeyNumber(uint8 button_number)
+static void KEYPAD_scanTask(void)
 {
-	uint8 keypad_button = 0;
-	switch(button_number)
-	{
-		case 1: keypad_button = 7;
-				break;
-		case 2: keypad_button = 8;
-				break;
-		case 3: keypad_button = 9;
-				break;
-		case 4: keypad_button = '/'; // ASCII Code of %
-				break;
-		case 5: keypad_button = 4;
-				break;
-		case 6: keypad_button = 5;
-				break;
-		case 7: keypad_button = 6;
-				break;
-		case 8: keypad_button = '*'; /* ASCII Code of '*' */
-				break;		
-		case 9: keypad_button = 1;
-				break;
-		case 10: keypad_button = 2;
-				break;
-		case 11: keypad_button = 3;
-				break;
-		case 12: keypad_button = '-'; /* ASCII Code of '-' */
-				break;
-		case 13: keypad_button = 13;  /* ASCII of Enter */
-				break;			
-		case 14: keypad_button = 0;
-				break;
-		case 15: keypad_button = '='; /* ASCII Code of '=' */
-				break;
-		case 16: keypad_button = '+'; /* ASCII Code of '+' */
-				break;
-		default: keypad_button = button_number;
-				break;
-	}
-	return keypad_button;
-} 
+	uint8 row, index, columns, key;
+	KEYPAD_KeysType pressed = 0;
+	KEYPAD_KeysType pending;
 
+	for(row=0 ; row<KEYPAD_NUM_ROWS ; row++)
+	{
+		GPIO_REG(GPIO_DDR_ADDRESS(KEYPAD_ROW_PORT_ID)) |= KEYPAD_ROW_BIT(row); /* Drive the row */
+		_NOP(); /* The column level needs one cycle to reach PIN (input synchronizer) */
+		columns = (uint8)(GPIO_REG(GPIO_PIN_ADDRESS(KEYPAD_COL_PORT_ID)) >> KEYPAD_FIRST_COL_PIN_ID);
+		GPIO_REG(GPIO_DDR_ADDRESS(KEYPAD_ROW_PORT_ID)) &= (uint8)~KEYPAD_ROW_BIT(row); /* Release it */
+#if (KEYPAD_BUTTON_PRESSED == LOGIC_LOW)
+		columns = (uint8)~columns;
 #endif
+		if(columns & KEYPAD_COLS_MASK)
+		{
+			_delay_us(KEYPAD_SETTLE_US); /* Let the columns its keys pulled rise back before the next row */
+		}
+		pressed |= (KEYPAD_KeysType)(columns & KEYPAD_COLS_MASK) << (row * KEYPAD_NUM_COLS);
+	}
 
-#endif /* STANDARD_KEYPAD */
+	pending = (pressed ^ g_KEYPAD_stable) | g_KEYPAD_counting;
+	for(index=0 ; pending ; index += KEYPAD_NUM_COLS, pending >>= KEYPAD_NUM_COLS)
+	{
+		for(columns = pending & KEYPAD_COLS_MASK ; columns ; columns &= (uint8)(columns - 1))
+		{
+			key = index + g_KEYPAD_firstColumn[columns];
+			KEYPAD_debounce(key, (pressed >> key) & 1);
+		}
+	}
+}
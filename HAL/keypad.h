@@ -19,28 +19,156 @@
  *                                Definitions                                  *
  *******************************************************************************/
 
-/* Keypad configurations for number of rows and columns */
+/* Supported keypad models (rows x columns) */
+#define KEYPAD_MODEL_4x3                  0   /* Phone keypad: digits, '*' and '#' */
+#define KEYPAD_MODEL_4x4                  1   /* Calculator keypad */
+#define KEYPAD_MODEL_4x5                  2   /* Calculator keypad with a column of function keys */
+
+/* Keypad model fitted on the board */
+#define KEYPAD_MODEL                      KEYPAD_MODEL_4x4
+
+/*
+ * Number of rows and columns of each model and the value of each key, row by
+ * row (same values KEYPAD_getPressedKey returns). The map is kept in flash.
+ */
+#if (KEYPAD_MODEL == KEYPAD_MODEL_4x3)
+
+#define KEYPAD_NUM_COLS                   3
+#define KEYPAD_NUM_ROWS                   4
+#define KEYPAD_KEY_MAP { \
+	1,   2, 3,   \
+	4,   5, 6,   \
+	7,   8, 9,   \
+	'*', 0, '#'  }
+
+#elif (KEYPAD_MODEL == KEYPAD_MODEL_4x4)
+
 #define KEYPAD_NUM_COLS                   4
 #define KEYPAD_NUM_ROWS                   4
+#define KEYPAD_KEY_MAP { \
+	7,  8, 9,   '/', \
+	4,  5, 6,   '*', \
+	1,  2, 3,   '-', \
+	13, 0, '=', '+'  } /* 13 is the ASCII of Enter */
+
+#elif (KEYPAD_MODEL == KEYPAD_MODEL_4x5)
+
+#define KEYPAD_NUM_COLS                   5
+#define KEYPAD_NUM_ROWS                   4
+#define KEYPAD_KEY_MAP { \
+	7,  8, 9,   '/', 'A', \
+	4,  5, 6,   '*', 'B', \
+	1,  2, 3,   '-', 'C', \
+	13, 0, '=', '+', 'D'  } /* 13 is the ASCII of Enter */
+
+#else
+#error "Unknown KEYPAD_MODEL"
+#endif
+
+/*
+ * STANDARD_KEYPAD, kept from the former driver: each key returns its switch
+ * number instead of its legend, 1 for the top left key and counting row by
+ * row, on whichever model KEYPAD_MODEL selects
+ */
+#ifdef STANDARD_KEYPAD
+#undef KEYPAD_KEY_MAP
+#if (KEYPAD_NUM_COLS == 3)
+#define KEYPAD_KEY_MAP { \
+	1,  2,  3,  \
+	4,  5,  6,  \
+	7,  8,  9,  \
+	10, 11, 12  }
+#elif (KEYPAD_NUM_COLS == 4)
+#define KEYPAD_KEY_MAP { \
+	1,  2,  3,  4,  \
+	5,  6,  7,  8,  \
+	9,  10, 11, 12, \
+	13, 14, 15, 16  }
+#else
+#define KEYPAD_KEY_MAP { \
+	1,  2,  3,  4,  5,  \
+	6,  7,  8,  9,  10, \
+	11, 12, 13, 14, 15, \
+	16, 17, 18, 19, 20  }
+#endif
+#endif /* STANDARD_KEYPAD */
+
+#define KEYPAD_NUM_OF_KEYS                (KEYPAD_NUM_ROWS * KEYPAD_NUM_COLS)
 
 /* Keypad Port Configurations */
 #define KEYPAD_ROW_PORT_ID                PORTB_ID
 #define KEYPAD_FIRST_ROW_PIN_ID           PIN0_ID
 
+#if (KEYPAD_NUM_COLS > 4)
+/* Five columns don't fit next to the rows: they move to PD3..PD7 */
+#define KEYPAD_COL_PORT_ID                PORTD_ID
+#define KEYPAD_FIRST_COL_PIN_ID           PIN3_ID
+#else
 #define KEYPAD_COL_PORT_ID                PORTB_ID
 #define KEYPAD_FIRST_COL_PIN_ID           PIN4_ID
+#endif
 
 /* Keypad button logic configurations */
 #define KEYPAD_BUTTON_PRESSED            LOGIC_LOW
 #define KEYPAD_BUTTON_RELEASED           LOGIC_HIGH
 
+/*
+ * Time a column pulled by a key of the released row takes to come back through
+ * its pull-up: sampled sooner, that key also shows up on the next row
+ */
+#ifndef KEYPAD_SETTLE_US
+#define KEYPAD_SETTLE_US                 5
+#endif
+
+/* Background scan configurations (Timer2 compare interrupt) */
+#define KEYPAD_SCAN_PERIOD_MS            2    /* Time between two scans of the whole keypad */
+#define KEYPAD_DEBOUNCE_SCANS            5    /* Scans a key must stay changed to be accepted (10ms) */
+#define KEYPAD_EVENT_QUEUE_SIZE          8    /* Key events FIFO size (power of two) */
+
+#if ((KEYPAD_EVENT_QUEUE_SIZE & (KEYPAD_EVENT_QUEUE_SIZE - 1)) != 0)
+#error "KEYPAD_EVENT_QUEUE_SIZE should be a power of two"
+#endif
+
+/*******************************************************************************
+ *                               Types Declaration                             *
+ *******************************************************************************/
+
+typedef enum {
+	KEYPAD_KEY_PRESSED,   /* Key went down */
+	KEYPAD_KEY_RELEASED   /* Key went up */
+} KEYPAD_EventKindType;
+
+typedef struct {
+	uint8 key;                  /* Key value (same values KEYPAD_getPressedKey returns) */
+	KEYPAD_EventKindType kind;  /* Press or release */
+} KEYPAD_EventType;
+
 /*******************************************************************************
  *                      Functions Prototypes                                   *
  *******************************************************************************/
 
 /*
  * Description :
- * Get the Keypad pressed button
+ * Setup the keypad pins and start the background scan on Timer2
+ */
+void KEYPAD_init(void);
+
+/*
+ * Description :
+ * Take the oldest key event without waiting.
+ * Returns TRUE and fills event, or FALSE if no event is waiting.
+ */
+boolean KEYPAD_pollEvent(KEYPAD_EventType *event);
+
+/*
+ * Description :
+ * Returns TRUE if a key event is waiting, without taking it.
+ */
+boolean KEYPAD_eventPending(void);
+
+/*
+ * Description :
+ * Wait for the next key press and return the Keypad pressed button
  */
 uint8 KEYPAD_getPressedKey(void);
 
@@ -36,4 +36,7 @@
 
 #define GET_BIT(Reg,bit_num)  ( ((Reg)>>(bit_num))&0x01)
 
+/* Add one to a 16-bit counter, it stays at 0xFFFF once there (no wrap to 0) */
+#define COUNT_SATURATED(COUNTER) do { if((COUNTER) != 0xFFFF) { (COUNTER)++; } } while(0)
+
 #endif
@@ -0,0 +1,28 @@
+/******************************************************************************
+ *
+ * File Name: io_access.h
+ *
+ * Description: Address of the memory mapped I/O registers used by the drivers
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef IO_ACCESS_H_
+#define IO_ACCESS_H_
+
+#include "std_types.h"
+
+#ifdef HMI_SIMULATION
+/*
+ * Host simulation build: each register access asks the simulated I/O space for
+ * the register, which lets the simulated peripherals see the previous access
+ * and update the register before it is used (see Simulation/sim_io.c).
+ */
+volatile uint8 *SIM_ioAccess(uint16 address);
+#define IO_ADDRESS(address) SIM_ioAccess(address)
+#else
+#define IO_ADDRESS(address) (address)
+#endif
+
+#endif /* IO_ACCESS_H_ */
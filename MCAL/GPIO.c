@@ -184,6 +184,20 @@ void GPIO_writePort(uint8 port_num, uint8 value) {
 	}
 }
 
+/*
+ * Description:
+ * Write value to the pins of the port selected by mask and keep the others.
+ * Interrupts are disabled during the read-modify-write of the port register.
+ * If the port number is invalid, the function does nothing.
+ */
+void GPIO_writePortMasked(uint8 port_num, uint8 mask, uint8 value) {
+	if (port_num >= NUM_OF_PORTS) {
+		/* Do Nothing */
+	} else {
+		GPIO_writePortMaskedInline(port_num, mask, value);
+	}
+}
+
 /*
  * Description:
  * Read the value of the specified port and return it.
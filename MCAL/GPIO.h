@@ -14,6 +14,8 @@
 #define GPIO_H_
 
 #include "../imp_files/std_types.h" // Include standard types header
+#include "../imp_files/io_access.h" // Include register address header
+#include <avr/interrupt.h>             // cli() for the masked port write
 
 /*******************************************************************************
  *                                Definitions                                  *
@@ -38,18 +40,27 @@
 #define PIN7_ID                7
 
 // Register definitions for each port and their data direction
-#define PORTA_REG      (*(volatile GPIO_Reg_Type*)0x3B) // Port A Data Register
-#define DDRA_REG       (*(volatile GPIO_Reg_Type*)0x3A) // Port A Data Direction Register
-#define PINA_REG       (*(volatile GPIO_Reg_Type*)0x39) // Port A Input Pins Register
-#define PORTB_REG      (*(volatile GPIO_Reg_Type*)0x38) // Port B Data Register
-#define DDRB_REG       (*(volatile GPIO_Reg_Type*)0x37) // Port B Data Direction Register
-#define PINB_REG       (*(volatile GPIO_Reg_Type*)0x36) // Port B Input Pins Register
-#define PORTC_REG      (*(volatile GPIO_Reg_Type*)0x35) // Port C Data Register
-#define DDRC_REG       (*(volatile GPIO_Reg_Type*)0x34) // Port C Data Direction Register
-#define PINC_REG       (*(volatile GPIO_Reg_Type*)0x33) // Port C Input Pins Register
-#define PORTD_REG      (*(volatile GPIO_Reg_Type*)0x32) // Port D Data Register
-#define DDRD_REG       (*(volatile GPIO_Reg_Type*)0x31) // Port D Data Direction Register
-#define PIND_REG       (*(volatile GPIO_Reg_Type*)0x30) // Port D Input Pins Register
+#define PORTA_REG      (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x3B)) // Port A Data Register
+#define DDRA_REG       (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x3A)) // Port A Data Direction Register
+#define PINA_REG       (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x39)) // Port A Input Pins Register
+#define PORTB_REG      (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x38)) // Port B Data Register
+#define DDRB_REG       (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x37)) // Port B Data Direction Register
+#define PINB_REG       (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x36)) // Port B Input Pins Register
+#define PORTC_REG      (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x35)) // Port C Data Register
+#define DDRC_REG       (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x34)) // Port C Data Direction Register
+#define PINC_REG       (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x33)) // Port C Input Pins Register
+#define PORTD_REG      (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x32)) // Port D Data Register
+#define DDRD_REG       (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x31)) // Port D Data Direction Register
+#define PIND_REG       (*(volatile GPIO_Reg_Type*)IO_ADDRESS(0x30)) // Port D Input Pins Register
+
+// Register addresses from the port ID (ports are 3 registers apart, PORTA at the top)
+#define GPIO_PIN_ADDRESS(port_num)   (0x39 - 3 * (port_num))
+#define GPIO_DDR_ADDRESS(port_num)   (0x3A - 3 * (port_num))
+#define GPIO_PORT_ADDRESS(port_num)  (0x3B - 3 * (port_num))
+#define GPIO_REG(address)            (*(volatile uint8*)IO_ADDRESS(address))
+
+// Status register, saved and restored around the masked port write
+#define GPIO_SREG_REG                (*(volatile uint8*)IO_ADDRESS(0x5F))
 
 /*******************************************************************************
  *                               Types Declaration                             *
@@ -131,4 +142,62 @@ void GPIO_writePort(uint8 port_num, uint8 value);
  */
 uint8 GPIO_readPort(uint8 port_num);
 
+/*
+ * Description :
+ * Write value to the pins of the port selected by mask, in one write, and keep
+ * the other pins as they are. Interrupts are disabled during the read-modify-write
+ * so an interrupt changing other pins of the same port is not undone.
+ * If the input port number is invalid, the function does nothing.
+ */
+void GPIO_writePortMasked(uint8 port_num, uint8 mask, uint8 value);
+
+/*******************************************************************************
+ *                              Inline Functions                               *
+ *******************************************************************************/
+
+/*
+ * Pin access resolved at compile time for the drivers' hot paths. With constant
+ * port and pin numbers (LCD_E_PORT_ID, LCD_E_PIN_ID...) each call compiles to a
+ * single sbi/cbi/sbic instruction instead of a call, a range check and a switch.
+ * Nothing is checked: the port and pin numbers must be valid. Use the functions
+ * above when they are only known at run time.
+ */
+static inline void GPIO_setupPinDirectionInline(uint8 port_num, uint8 pin_num,
+		GPIO_PinDirectionType direction) {
+	if (direction == PIN_OUTPUT) {
+		GPIO_REG(GPIO_DDR_ADDRESS(port_num)) |= (uint8)(1 << pin_num);
+	} else {
+		GPIO_REG(GPIO_DDR_ADDRESS(port_num)) &= (uint8)~(1 << pin_num);
+	}
+}
+
+static inline void GPIO_writePinInline(uint8 port_num, uint8 pin_num, uint8 value) {
+	if (value == LOGIC_HIGH) {
+		GPIO_REG(GPIO_PORT_ADDRESS(port_num)) |= (uint8)(1 << pin_num);
+	} else {
+		GPIO_REG(GPIO_PORT_ADDRESS(port_num)) &= (uint8)~(1 << pin_num);
+	}
+}
+
+static inline uint8 GPIO_readPinInline(uint8 port_num, uint8 pin_num) {
+	return (GPIO_REG(GPIO_PIN_ADDRESS(port_num)) & (1 << pin_num)) ? LOGIC_HIGH : LOGIC_LOW;
+}
+
+static inline void GPIO_writePortInline(uint8 port_num, uint8 value) {
+	GPIO_REG(GPIO_PORT_ADDRESS(port_num)) = value;
+}
+
+static inline void GPIO_writePortMaskedInline(uint8 port_num, uint8 mask, uint8 value) {
+	uint8 sreg = GPIO_SREG_REG;
+
+	cli();
+	GPIO_REG(GPIO_PORT_ADDRESS(port_num)) =
+			(uint8)((GPIO_REG(GPIO_PORT_ADDRESS(port_num)) & ~mask) | (value & mask));
+	GPIO_SREG_REG = sreg;
+}
+
+static inline void GPIO_setupPortDirectionInline(uint8 port_num, GPIO_PortDirectionType direction) {
+	GPIO_REG(GPIO_DDR_ADDRESS(port_num)) = (uint8)direction;
+}
+
 #endif /* GPIO_H_ */
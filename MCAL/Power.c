@@ -0,0 +1,48 @@
+/******************************************************************************
+ *
+ * Module: Power
+ *
+ * File Name: Power.c
+ *
+ * Description: Source file for the AVR idle sleep and power statistics
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "Power.h"                 // Include the Power header file
+#include "Timer.h"                 // Include the Timer header file (system clock)
+#include <avr/interrupt.h>         // Include AVR interrupt header
+#include <avr/sleep.h>             // Include AVR sleep header
+
+// Time spent asleep, kept as whole seconds plus microseconds so a wake-up costs no division
+static uint32 g_sleepSeconds = 0;
+static uint32 g_sleepUs = 0;
+
+// Function to sleep until the next interrupt
+void Power_idle(void) {
+    uint32 start = Timer_nowUs();
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei(); // The instruction after SEI always runs first, so no interrupt can be lost before SLEEP
+    sleep_cpu();
+    sleep_disable();
+
+    // The waking interrupt has run by now, so the clock is up to date
+    g_sleepUs += Timer_nowUs() - start;
+    while (g_sleepUs >= 1000000UL) {
+        g_sleepUs -= 1000000UL;
+        g_sleepSeconds++;
+    }
+}
+
+// Function to get the total sleep time
+uint32 Power_getSleepMs(void) {
+    return (g_sleepSeconds * 1000UL) + (g_sleepUs / 1000UL);
+}
+
+// Function to get the total running time
+uint32 Power_getActiveMs(void) {
+    return Timer_nowMs() - Power_getSleepMs();
+}
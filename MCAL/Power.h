@@ -0,0 +1,44 @@
+/******************************************************************************
+ *
+ * Module: Power
+ *
+ * File Name: Power.h
+ *
+ * Description: Header file for the AVR idle sleep and power statistics
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include "../imp_files/std_types.h" // Include standard types header
+
+/*******************************************************************************
+ *                              Functions Prototypes                           *
+ *******************************************************************************/
+
+/*
+ * Description :
+ * Puts the CPU in IDLE sleep until the next interrupt (system tick, keypad scan,
+ * LCD queue, UART RX/TX) and adds the time spent asleep to the statistics.
+ * Must be called with interrupts disabled, right after checking that no work is
+ * pending, and returns with interrupts enabled. IDLE is the deepest mode usable
+ * here: the deeper modes stop Timer0/Timer1 and the UART clock.
+ */
+void Power_idle(void);
+
+/*
+ * Description :
+ * Returns the milliseconds spent in sleep since Timer_startTick.
+ */
+uint32 Power_getSleepMs(void);
+
+/*
+ * Description :
+ * Returns the milliseconds spent running since Timer_startTick.
+ */
+uint32 Power_getActiveMs(void);
+
+#endif /* POWER_H_ */
@@ -14,14 +14,53 @@
 #include <avr/interrupt.h>
 #include "../imp_files/std_types.h"
 
-// Global variables to track total ticks and individual ticks
-volatile uint8 g_total_ticks = 0; // Total ticks
-volatile static uint8 g_ticks = 0; // Current tick count
+// Status register, saved and restored around the deferred-work queue update
+#define TIMER_SREG_REG (*(volatile uint8*)IO_ADDRESS(0x5F))
+
+// Marks the end of the software timers list
+#define TIMER_SOFT_NONE 0xFF
+
+// Timer1 in CTC mode, compare match every TIMER_TICK_MS
+#define TIMER_TICK_US        (TIMER_TICK_MS * 1000UL)
+#define TIMER_TICK_PRESCALER TIMER_PRESCALER(TIMER_TICK_US, 65536)
+
+#if (TIMER_TICK_PRESCALER == 0) || (TIMER_ERROR(TIMER_TICK_US, TIMER_TICK_PRESCALER) > TIMER_MAX_PERIOD_ERROR)
+#error "TIMER_TICK_MS can't be produced by Timer1 at this F_CPU"
+#endif
+
+static const Timer_ConfigType g_tickConfig = { 0,
+        (uint16)TIMER_COMPARE(TIMER_TICK_US, TIMER_TICK_PRESCALER), TIMER1_ID,
+        TIMER_CLOCK(TIMER_TICK_PRESCALER), CTC_1 };
+
+// Milliseconds since the system tick started, counted by the Timer1 compare interrupt
+static volatile uint32 g_nowMs = 0;
+
+/*
+ * Software timers, kept in a list sorted by expiry time where each timer
+ * holds its ticks relative to the previous one (delta list), so a tick only
+ * decrements the head of the list.
+ */
+static uint16 g_softDelta[TIMER_NUM_OF_SOFT_TIMERS];  // Ticks after the previous timer in the list
+static uint16 g_softPeriod[TIMER_NUM_OF_SOFT_TIMERS]; // Period in ticks
+static uint8 g_softNext[TIMER_NUM_OF_SOFT_TIMERS];    // Next timer in the list
+static uint8 g_softMode[TIMER_NUM_OF_SOFT_TIMERS];    // One-shot or periodic
+static void (*g_softCallBack[TIMER_NUM_OF_SOFT_TIMERS])(void);
+static volatile uint8 g_softHead = TIMER_SOFT_NONE;   // Timer expiring first
+static volatile uint8 g_softRunning = 0;              // One bit per running timer
+
+// Deferred-work queue, written by the interrupts and read by the main loop
+static void (*volatile g_deferredQueue[TIMER_DEFERRED_QUEUE_SIZE])(void);
+static uint8 g_deferredTimer[TIMER_DEFERRED_QUEUE_SIZE]; // Software timer that posted the entry, or TIMER_SOFT_NONE
+static volatile uint8 g_deferredHead = 0; // Next free entry (owned by the interrupts)
+static volatile uint8 g_deferredTail = 0; // Next entry to run (owned by the main loop)
+
+// Timer2 clock select values for each Timer_ClockType (Timer2 has its own prescaler table)
+static const uint8 g_Timer2_clockSelect[] = { 0, 1, 2, 4, 6, 7 };
 
 // Function pointers for timer callbacks
-static volatile void (*g_Timer0_callBackPtr)(void) = NULL_PTR;
-static volatile void (*g_Timer1_callBackPtr)(void) = NULL_PTR;
-static volatile void (*g_Timer2_callBackPtr)(void) = NULL_PTR;
+static void (*volatile g_Timer0_callBackPtr)(void) = NULL_PTR;
+static void (*volatile g_Timer1_callBackPtr)(void) = NULL_PTR;
+static void (*volatile g_Timer2_callBackPtr)(void) = NULL_PTR;
 
 // Function to initialize the timer based on the provided configuration
 void Timer_init(const Timer_ConfigType *Config_Ptr) {
@@ -75,12 +114,13 @@ void Timer_init(const Timer_ConfigType *Config_Ptr) {
 
         case TIMER2_ID: {
             // Configure Timer2
+            uint8 clock_select = g_Timer2_clockSelect[Config_Ptr->timer_clock];
             TCCR2_REG.Bits.FOC2_Bit = LOGIC_HIGH; // Force Output Compare
             TCCR2_REG.Bits.WGM20_Bit = GET_BIT(Config_Ptr->timer_mode, 0); // Set mode bits
             TCCR2_REG.Bits.WGM21_Bit = GET_BIT(Config_Ptr->timer_mode, 1);
-            TCCR2_REG.Bits.CS20_Bit = GET_BIT(Config_Ptr->timer_clock, 0); // Set clock source
-            TCCR2_REG.Bits.CS21_Bit = GET_BIT(Config_Ptr->timer_clock, 1);
-            TCCR2_REG.Bits.CS22_Bit = GET_BIT(Config_Ptr->timer_clock, 2);
+            TCCR2_REG.Bits.CS20_Bit = GET_BIT(clock_select, 0); // Set clock source
+            TCCR2_REG.Bits.CS21_Bit = GET_BIT(clock_select, 1);
+            TCCR2_REG.Bits.CS22_Bit = GET_BIT(clock_select, 2);
             TCNT2_REG.Byte = Config_Ptr->timer_InitialValue; // Set initial value
             // Configure compare match mode or normal mode
             if (Config_Ptr->timer_mode == CTC_0_OR_2) {
@@ -160,6 +200,218 @@ void Timer_setCallBack(void (*a_ptr)(void), Timer_ID_Type a_timer_ID) {
     }
 }
 
+// Function to post a function to the deferred-work queue for a software timer or TIMER_SOFT_NONE
+static boolean Timer_post(void (*a_ptr)(void), uint8 timer_id) {
+    uint8 sreg = TIMER_SREG_REG;
+    uint8 head;
+    boolean posted = FALSE;
+
+    cli(); // Interrupts may post too, keep the head update atomic
+    head = g_deferredHead;
+    if (((head + 1) & (TIMER_DEFERRED_QUEUE_SIZE - 1)) != g_deferredTail) {
+        g_deferredQueue[head] = a_ptr;
+        g_deferredTimer[head] = timer_id;
+        g_deferredHead = (head + 1) & (TIMER_DEFERRED_QUEUE_SIZE - 1);
+        posted = TRUE;
+    }
+    TIMER_SREG_REG = sreg; // Restore the interrupt state
+
+    return posted;
+}
+
+// Function to drop the expiries of a stopped or restarted software timer still in the
+// deferred-work queue, they are stale (interrupts must be disabled)
+static void Timer_softCancelPosted(uint8 id) {
+    uint8 i;
+
+    for (i = g_deferredTail; i != g_deferredHead; i = (i + 1) & (TIMER_DEFERRED_QUEUE_SIZE - 1)) {
+        if (g_deferredTimer[i] == id) {
+            g_deferredQueue[i] = NULL_PTR; // Skipped by Timer_dispatchDeferred
+        }
+    }
+}
+
+// Function to insert a software timer in the delta list (interrupts must be disabled)
+static void Timer_softInsert(uint8 id, uint16 ticks) {
+    uint8 prev = TIMER_SOFT_NONE;
+    uint8 cur = g_softHead;
+
+    // Skip the timers expiring before (or with) this one
+    while ((cur != TIMER_SOFT_NONE) && (ticks >= g_softDelta[cur])) {
+        ticks -= g_softDelta[cur];
+        prev = cur;
+        cur = g_softNext[cur];
+    }
+
+    g_softDelta[id] = ticks;
+    g_softNext[id] = cur;
+    if (cur != TIMER_SOFT_NONE) {
+        g_softDelta[cur] -= ticks; // The next one is now relative to this timer
+    }
+    if (prev == TIMER_SOFT_NONE) {
+        g_softHead = id;
+    } else {
+        g_softNext[prev] = id;
+    }
+    SET_BIT(g_softRunning, id);
+}
+
+// Function to remove a software timer from the delta list (interrupts must be disabled)
+static void Timer_softRemove(uint8 id) {
+    uint8 prev = TIMER_SOFT_NONE;
+    uint8 cur = g_softHead;
+
+    while ((cur != TIMER_SOFT_NONE) && (cur != id)) {
+        prev = cur;
+        cur = g_softNext[cur];
+    }
+    if (cur == TIMER_SOFT_NONE) {
+        return; // Not in the list
+    }
+
+    if (g_softNext[id] != TIMER_SOFT_NONE) {
+        g_softDelta[g_softNext[id]] += g_softDelta[id]; // Give its ticks to the next one
+    }
+    if (prev == TIMER_SOFT_NONE) {
+        g_softHead = g_softNext[id];
+    } else {
+        g_softNext[prev] = g_softNext[id];
+    }
+    CLEAR_BIT(g_softRunning, id);
+}
+
+// Function to process one system tick: only the head of the delta list is decremented
+static void Timer_softTick(void) {
+    uint8 id;
+
+    if (g_softHead == TIMER_SOFT_NONE) {
+        return;
+    }
+    if (g_softDelta[g_softHead] != 0) {
+        g_softDelta[g_softHead]--;
+    }
+
+    // Expire all the timers that reached zero
+    while ((g_softHead != TIMER_SOFT_NONE) && (g_softDelta[g_softHead] == 0)) {
+        id = g_softHead;
+        g_softHead = g_softNext[id];
+        CLEAR_BIT(g_softRunning, id);
+        Timer_post(g_softCallBack[id], id); // Run it from the main loop
+        if (g_softMode[id] == TIMER_PERIODIC) {
+            Timer_softInsert(id, g_softPeriod[id]);
+        }
+    }
+}
+
+// Function to start Timer1 as the system tick
+void Timer_startTick(void) {
+    Timer_init(&g_tickConfig);
+}
+
+// Function to read the millisecond clock
+uint32 Timer_nowMs(void) {
+    uint8 sreg = TIMER_SREG_REG;
+    uint32 now;
+
+    cli(); // 32-bit read is not atomic on the AVR
+    now = g_nowMs;
+    TIMER_SREG_REG = sreg;
+
+    return now;
+}
+
+// Function to read the microsecond clock
+uint32 Timer_nowUs(void) {
+    uint8 sreg = TIMER_SREG_REG;
+    uint32 ms;
+    uint16 count;
+
+    cli();
+    ms = g_nowMs;
+    count = TCNT1_REG.TwoBytes;
+    if (TIFR_REG.Bits.OCF1A_Bit && (count < g_tickConfig.timer_compare_MatchValue)) {
+        ms += TIMER_TICK_MS; // The counter restarted but the tick interrupt is still pending
+    }
+    TIMER_SREG_REG = sreg;
+
+    // One Timer1 count is TIMER_TICK_PRESCALER / F_CPU seconds
+    return (ms * 1000UL) + (uint32)(((uint32)count * (TIMER_TICK_PRESCALER * 1000UL)) / (F_CPU / 1000UL));
+}
+
+// Function to start or restart a software timer
+boolean Timer_softStart(uint8 a_timer_ID, uint16 period_ms,
+        Timer_SoftModeType mode, void (*a_ptr)(void)) {
+    uint8 sreg;
+    uint16 ticks = period_ms / TIMER_TICK_MS;
+
+    if ((a_timer_ID >= TIMER_NUM_OF_SOFT_TIMERS) || (a_ptr == NULL_PTR)) {
+        return FALSE;
+    }
+    if (ticks == 0) {
+        ticks = 1; // Expire on the next tick at the earliest
+    }
+
+    sreg = TIMER_SREG_REG;
+    cli(); // The tick interrupt walks the same list
+    Timer_softRemove(a_timer_ID);
+    Timer_softCancelPosted(a_timer_ID);
+    g_softPeriod[a_timer_ID] = ticks;
+    g_softMode[a_timer_ID] = mode;
+    g_softCallBack[a_timer_ID] = a_ptr;
+    Timer_softInsert(a_timer_ID, ticks);
+    TIMER_SREG_REG = sreg; // Restore the interrupt state
+
+    return TRUE;
+}
+
+// Function to cancel a software timer
+void Timer_softStop(uint8 a_timer_ID) {
+    uint8 sreg;
+
+    if (a_timer_ID >= TIMER_NUM_OF_SOFT_TIMERS) {
+        return;
+    }
+
+    sreg = TIMER_SREG_REG;
+    cli();
+    Timer_softRemove(a_timer_ID);
+    Timer_softCancelPosted(a_timer_ID);
+    TIMER_SREG_REG = sreg;
+}
+
+// Function to check if a software timer is running
+boolean Timer_softIsRunning(uint8 a_timer_ID) {
+    if (a_timer_ID >= TIMER_NUM_OF_SOFT_TIMERS) {
+        return FALSE;
+    }
+    return BIT_IS_SET(g_softRunning, a_timer_ID) ? TRUE : FALSE;
+}
+
+// Function to post a function to the deferred-work queue
+boolean Timer_postDeferred(void (*a_ptr)(void)) {
+    return Timer_post(a_ptr, TIMER_SOFT_NONE);
+}
+
+// Function to run the posted functions from the main loop
+void Timer_dispatchDeferred(void) {
+    uint8 tail = g_deferredTail;
+    void (*work)(void);
+
+    while (tail != g_deferredHead) {
+        work = g_deferredQueue[tail];
+        tail = (tail + 1) & (TIMER_DEFERRED_QUEUE_SIZE - 1);
+        g_deferredTail = tail; // Free the entry before running it
+        if (work != NULL_PTR) { // NULL_PTR: cancelled expiry of a software timer
+            work();
+        }
+    }
+}
+
+// Function to check the deferred-work queue
+boolean Timer_deferredPending(void) {
+    return (g_deferredTail != g_deferredHead);
+}
+
 // Timer0 overflow interrupt service routine
 ISR(TIMER0_OVF_vect) {
     if (g_Timer0_callBackPtr != NULL_PTR) {
@@ -191,17 +443,16 @@ ISR(TIMER2_OVF_vect) {
 // Timer1 overflow interrupt service routine
 ISR(TIMER1_OVF_vect) {
     if (g_Timer1_callBackPtr != NULL_PTR) {
-        (void) (*g_Timer1_callBackPtr)(); // Call the registered callback
+        Timer_postDeferred(g_Timer1_callBackPtr); // Run it from the main loop
     }
 }
 
-// Timer1 compare match interrupt service routine
+// Timer1 compare match interrupt service routine (system tick)
 ISR(TIMER1_COMPA_vect) {
-    g_ticks++; // Increment tick count
+    g_nowMs += TIMER_TICK_MS; // Advance the millisecond clock
+    Timer_softTick(); // Expire the software timers
 
-    // Call the registered callback when total ticks are reached
-    if (g_Timer1_callBackPtr != NULL_PTR && (g_ticks == g_total_ticks)) {
-        g_ticks = 0; // Reset tick count
-        g_Timer1_callBackPtr(); // Call the registered callback
+    if (g_Timer1_callBackPtr != NULL_PTR) {
+        Timer_postDeferred(g_Timer1_callBackPtr); // Run it from the main loop
     }
 }
@@ -13,6 +13,7 @@
 #define TIMER_H_
 
 #include "../imp_files/std_types.h"
+#include "../imp_files/io_access.h"
 
 /*******************************************************************************
  *                      Definitions                                            *
@@ -20,34 +21,79 @@
 // Define the total number of timers available
 #define NUM_OF_Timers          3
 
-// Global variable to keep track of total ticks
-extern volatile uint8 g_total_ticks;
+// System tick period of Timer1 in milliseconds, drives the software timers
+#define TIMER_TICK_MS 1
+
+// Number of software timers (IDs 0 .. TIMER_NUM_OF_SOFT_TIMERS - 1, max 8)
+#define TIMER_NUM_OF_SOFT_TIMERS 8
+
+#if (TIMER_NUM_OF_SOFT_TIMERS > 8)
+#error "TIMER_NUM_OF_SOFT_TIMERS should not be more than 8"
+#endif
+
+// Size of the deferred-work queue (power of two, max 128)
+#define TIMER_DEFERRED_QUEUE_SIZE 8
+
+#if ((TIMER_DEFERRED_QUEUE_SIZE & (TIMER_DEFERRED_QUEUE_SIZE - 1)) != 0) || (TIMER_DEFERRED_QUEUE_SIZE > 128)
+#error "TIMER_DEFERRED_QUEUE_SIZE should be a power of two and not more than 128"
+#endif
+
+/*
+ * Compile-time CTC settings from F_CPU, for constant periods in microseconds
+ * (usable in #if, so a period the timer can't produce fails the build):
+ *  TIMER_COUNTS     timer counts in one period with this prescaler (rounded)
+ *  TIMER_PRESCALER  smallest prescaler whose counts fit in max_counts (256 for
+ *                   Timer0/Timer2, 65536 for Timer1), 0 if the period is too long
+ *  TIMER_COMPARE    compare match value of the period
+ *  TIMER_ERROR      period error of the rounded counts, in 0.1%
+ *  TIMER_CLOCK      Timer_ClockType of a prescaler
+ */
+#define TIMER_MAX_PERIOD_ERROR 20 // 2%
+
+#define TIMER_CYCLES(period_us)  ((F_CPU) * 1ULL * (period_us) / 1000000ULL)
+#define TIMER_COUNTS(period_us, prescaler) \
+	((TIMER_CYCLES(period_us) + (prescaler) / 2) / (prescaler))
+#define TIMER_PRESCALER(period_us, max_counts) \
+	((TIMER_COUNTS(period_us, 1) <= (max_counts)) ? 1 : \
+	 (TIMER_COUNTS(period_us, 8) <= (max_counts)) ? 8 : \
+	 (TIMER_COUNTS(period_us, 64) <= (max_counts)) ? 64 : \
+	 (TIMER_COUNTS(period_us, 256) <= (max_counts)) ? 256 : \
+	 (TIMER_COUNTS(period_us, 1024) <= (max_counts)) ? 1024 : 0)
+#define TIMER_COMPARE(period_us, prescaler)  (TIMER_COUNTS(period_us, prescaler) - 1)
+#define TIMER_ERROR(period_us, prescaler) \
+	(((TIMER_COUNTS(period_us, prescaler) * (prescaler) > TIMER_CYCLES(period_us)) ? \
+	  (TIMER_COUNTS(period_us, prescaler) * (prescaler) - TIMER_CYCLES(period_us)) : \
+	  (TIMER_CYCLES(period_us) - TIMER_COUNTS(period_us, prescaler) * (prescaler))) \
+	 * 1000ULL / TIMER_CYCLES(period_us))
+#define TIMER_CLOCK(prescaler) \
+	(((prescaler) == 1) ? No_PRESCALING : ((prescaler) == 8) ? CLK_OVER_8 : \
+	 ((prescaler) == 64) ? CLK_OVER_64 : ((prescaler) == 256) ? CLK_OVER_256 : CLK_OVER_1024)
 
 /*********************************** Timers Registers Definitions ******************************/
 // Define memory-mapped registers for timer interrupt flags
-#define TIFR_REG      (*(volatile Timers_TIFR_Type*)0x58) // Timer Interrupt Flag Register
-#define TIMSK_REG     (*(volatile Timers_TIMSK_Type*)0x59) // Timer Interrupt Mask Register
+#define TIFR_REG      (*(volatile Timers_TIFR_Type*)IO_ADDRESS(0x58)) // Timer Interrupt Flag Register
+#define TIMSK_REG     (*(volatile Timers_TIMSK_Type*)IO_ADDRESS(0x59)) // Timer Interrupt Mask Register
 
 /*********************************** Timer0 Registers Definitions ******************************/
 // Define memory-mapped registers for Timer0
-#define TCNT0_REG    (*(volatile Timer0_TCNT0_Type*)0x52) // Timer/Counter Register
-#define TCCR0_REG    (*(volatile Timer0_TCCR0_Type*)0x53) // Timer/Counter Control Register
-#define OCR0_REG     (*(volatile Timer0_OCR0_Type*)0x5C) // Output Compare Register
+#define TCNT0_REG    (*(volatile Timer0_TCNT0_Type*)IO_ADDRESS(0x52)) // Timer/Counter Register
+#define TCCR0_REG    (*(volatile Timer0_TCCR0_Type*)IO_ADDRESS(0x53)) // Timer/Counter Control Register
+#define OCR0_REG     (*(volatile Timer0_OCR0_Type*)IO_ADDRESS(0x5C)) // Output Compare Register
 
 /*********************************** Timer1 Registers Definitions ******************************/
 // Define memory-mapped registers for Timer1
-#define TCNT1_REG     (*(volatile Timer1_TCNT1_Type*)0x4C) // Timer/Counter Register
-#define TCCR1A_REG    (*(volatile Timer1_TCCR1A_Type*)0x4F) // Timer/Counter Control Register A
-#define TCCR1B_REG    (*(volatile Timer1_TCCR1B_Type*)0x4E) // Timer/Counter Control Register B
-#define OCR1A_REG     (*(volatile Timer1_OCR1A_Type*)0x4A) // Output Compare Register A
-#define OCR1B_REG     (*(volatile Timer1_OCR1B_Type*)0x48) // Output Compare Register B
-#define ICR1_REG      (*(volatile Timer1_ICR1_Type*)0x46)  // Input Capture Register
+#define TCNT1_REG     (*(volatile Timer1_TCNT1_Type*)IO_ADDRESS(0x4C)) // Timer/Counter Register
+#define TCCR1A_REG    (*(volatile Timer1_TCCR1A_Type*)IO_ADDRESS(0x4F)) // Timer/Counter Control Register A
+#define TCCR1B_REG    (*(volatile Timer1_TCCR1B_Type*)IO_ADDRESS(0x4E)) // Timer/Counter Control Register B
+#define OCR1A_REG     (*(volatile Timer1_OCR1A_Type*)IO_ADDRESS(0x4A)) // Output Compare Register A
+#define OCR1B_REG     (*(volatile Timer1_OCR1B_Type*)IO_ADDRESS(0x48)) // Output Compare Register B
+#define ICR1_REG      (*(volatile Timer1_ICR1_Type*)IO_ADDRESS(0x46))  // Input Capture Register
 
 /*********************************** Timer2 Registers Definitions ******************************/
 // Define memory-mapped registers for Timer2
-#define TCNT2_REG     (*(volatile Timer2_TCNT2_Type*)0x44) // Timer/Counter Register
-#define TCCR2_REG     (*(volatile Timer2_TCCR2_Type*)0x45) // Timer/Counter Control Register
-#define OCR2_REG      (*(volatile Timer2_OCR2_Type*)0x43)  // Output Compare Register
+#define TCNT2_REG     (*(volatile Timer2_TCNT2_Type*)IO_ADDRESS(0x44)) // Timer/Counter Register
+#define TCCR2_REG     (*(volatile Timer2_TCCR2_Type*)IO_ADDRESS(0x45)) // Timer/Counter Control Register
+#define OCR2_REG      (*(volatile Timer2_OCR2_Type*)IO_ADDRESS(0x43))  // Output Compare Register
 
 /*******************************************************************************
  *                      Types Declaration                                      *
@@ -306,6 +352,12 @@ typedef union {
 	} Bits;
 } Timer2_OCR2_Type;
 
+// Enum for software timer modes
+typedef enum {
+	TIMER_ONE_SHOT, // Expires once
+	TIMER_PERIODIC  // Restarts with the same period after each expiry
+} Timer_SoftModeType;
+
 /****************************************************************************************************/
 // Structure for timer configuration parameters
 typedef struct {
@@ -334,7 +386,76 @@ void Timer_deInit(Timer_ID_Type timer_type);
 /*
  * Description :
  * Sets the callback function address for the specified Timer.
+ * Timer0 and Timer2 callbacks run inside the interrupt (for drivers, keep them short).
+ * Timer1 callbacks are deferred: the interrupt only posts them to the deferred-work
+ * queue and they run from Timer_dispatchDeferred in the main loop.
  */
 void Timer_setCallBack(void (*a_ptr)(void), Timer_ID_Type a_timer_ID);
 
+/*
+ * Description :
+ * Starts Timer1 as the system tick (every TIMER_TICK_MS) that drives the
+ * software timers. Timer1 is reserved for the system tick after this call.
+ */
+void Timer_startTick(void);
+
+/*
+ * Description :
+ * Returns the milliseconds elapsed since Timer_startTick (wraps after ~49 days).
+ * Safe to call from the main loop and from interrupts.
+ */
+uint32 Timer_nowMs(void);
+
+/*
+ * Description :
+ * Returns the microseconds elapsed since Timer_startTick, using the Timer1
+ * count inside the current tick (wraps after ~71 minutes).
+ * Safe to call from the main loop and from interrupts.
+ */
+uint32 Timer_nowUs(void);
+
+/*
+ * Description :
+ * Starts (or restarts) the software timer a_timer_ID to expire after period_ms,
+ * once or periodically. On each expiry a_ptr is posted to the deferred-work
+ * queue, so it runs from Timer_dispatchDeferred in the main loop. An expiry of
+ * the previous run still waiting in that queue is dropped.
+ * Returns FALSE if the ID is invalid.
+ */
+boolean Timer_softStart(uint8 a_timer_ID, uint16 period_ms,
+		Timer_SoftModeType mode, void (*a_ptr)(void));
+
+/*
+ * Description :
+ * Cancels the software timer a_timer_ID (does nothing if it is not running),
+ * including an expiry already posted but not run yet by Timer_dispatchDeferred.
+ */
+void Timer_softStop(uint8 a_timer_ID);
+
+/*
+ * Description :
+ * Returns TRUE if the software timer a_timer_ID is running.
+ */
+boolean Timer_softIsRunning(uint8 a_timer_ID);
+
+/*
+ * Description :
+ * Posts a function to the deferred-work queue (safe from interrupts).
+ * Returns FALSE if the queue is full and the function was dropped.
+ */
+boolean Timer_postDeferred(void (*a_ptr)(void));
+
+/*
+ * Description :
+ * Runs all the functions posted to the deferred-work queue, in order.
+ * To be called from the main loop.
+ */
+void Timer_dispatchDeferred(void);
+
+/*
+ * Description :
+ * Returns TRUE if functions are waiting in the deferred-work queue.
+ */
+boolean Timer_deferredPending(void);
+
 #endif /* TIMER_H_ */
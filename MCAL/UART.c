@@ -11,14 +11,180 @@
  *******************************************************************************/
 
 #include "UART.h"                  // Include the UART header file
+#include "Timer.h"                 // Include the Timer header file (timeouts)
+#include "GPIO.h"                  // Include the GPIO header file (RTS/CTS pins)
 #include "../imp_files/common_macros.h" // Include common macros
 #include <avr/interrupt.h>         // Include AVR interrupt header
+#include <util/delay.h>            // Include delay header (timeouts with interrupts disabled)
 #include "../imp_files/std_types.h" // Include standard types
 
-// Global variables for UART status flags
-uint8 volatile g_UART_recieve_flag = 0; // Flag for indicating byte received
-uint8 volatile g_UART_UDR_EMP_flag = 0;  // Flag for UDR empty status
-uint8 volatile g_UART_UDRvalue;           // Value received in UDR
+// Status register, used to know if the blocking calls run with interrupts disabled
+#define UART_SREG_REG (*(volatile uint8*) IO_ADDRESS(0x5F))
+#define UART_SREG_I_bitNum 7
+
+/*
+ * UCSRA is only written through this macro, never as a bitfield: a
+ * read-modify-write would write back a set TXC (cleared by writing one) and
+ * the FE/DOR/PE flags (always to be written as zero). It keeps U2X and MPCM,
+ * the only control bits of the register, and changes those in mask to bits.
+ */
+#define UART_UCSRA_CONTROL_MASK ((1 << U2X_bitNum) | (1 << MPCM_bitNum))
+#define UART_WRITE_UCSRA(mask, bits) \
+    (UCSRA_REG.Byte = (uint8)((UCSRA_REG.Byte & UART_UCSRA_CONTROL_MASK & ~(mask)) | ((bits) & (mask))))
+
+// External interrupt 0 registers, for the CTS input
+#define UART_MCUCR_REG (*(volatile uint8*) IO_ADDRESS(0x55))
+#define UART_GICR_REG  (*(volatile uint8*) IO_ADDRESS(0x5B))
+#define UART_GIFR_REG  (*(volatile uint8*) IO_ADDRESS(0x5A))
+#define UART_ISC00_bitNum 0 // ISC01:ISC00 = 01: INT0 on any logical change
+#define UART_INT0_bitNum  6 // INT0 enable in GICR, INTF0 flag in GIFR
+
+// Address of this node on a multi-drop bus, UART_NO_ADDRESS on a point-to-point link
+static uint8 g_UART_nodeAddress = UART_NO_ADDRESS;
+
+// UART_BAUD_SETTING in use (UBRRH shares its address with UCSRC, so it is not read back)
+static uint16 g_UART_baudSetting = 0;
+
+// Bytes received with a frame error or an overrun (saturates at 0xFF)
+static volatile uint8 g_UART_lineErrors = 0;
+
+// Link quality counters, updated by the RXC/UDRE interrupts
+static volatile UART_StatsType g_UART_stats;
+
+// RX ring buffer, written by USART_RXC_vect and read by the application
+static volatile uint8 g_UART_rxBuffer[UART_RX_BUFFER_SIZE];
+static volatile uint8 g_UART_rxHead = 0; // Next free slot (owned by the ISR)
+static volatile uint8 g_UART_rxTail = 0; // Oldest byte (owned by the application)
+
+// TX ring buffer, written by the application and drained by USART_UDRE_vect
+static volatile uint8 g_UART_txBuffer[UART_TX_BUFFER_SIZE];
+static volatile uint8 g_UART_txHead = 0; // Next free slot (owned by the application)
+static volatile uint8 g_UART_txTail = 0; // Next byte to send (owned by the ISR)
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+#if UART_FLOW_CONTROL
+// Restart the sending stopped by CTS, once CTS is low again
+static inline void UART_ctsHandler(void) {
+    if ((GPIO_readPinInline(UART_CTS_PORT_ID, UART_CTS_PIN_ID) == LOGIC_LOW)
+            && (g_UART_txTail != g_UART_txHead)) {
+        UCSRB_REG.Bits.UDRIE_Bit = LOGIC_HIGH;
+    }
+}
+#endif
+
+// Move the received byte from UDR to the RX ring buffer (drops it if the buffer is full)
+static inline void UART_rxHandler(void) {
+    UART_UCSRA_Type status = UCSRA_REG; // Error flags and RXB8 must be read before UDR
+    uint8 address_frame = UCSRB_REG.Bits.RXB8_Bit;
+    uint8 data = UDR_REG;
+    uint8 next;
+
+    if (status.Bits.FE_Bit || status.Bits.DOR_Bit || status.Bits.PE_Bit) {
+        if (status.Bits.FE_Bit) {
+            COUNT_SATURATED(g_UART_stats.frame_errors);
+        }
+        if (status.Bits.DOR_Bit) {
+            COUNT_SATURATED(g_UART_stats.overruns);
+        }
+        if (status.Bits.PE_Bit) {
+            COUNT_SATURATED(g_UART_stats.parity_errors);
+        }
+        if ((status.Bits.FE_Bit || status.Bits.DOR_Bit) && (g_UART_lineErrors != 0xFF)) {
+            g_UART_lineErrors++;
+        }
+    }
+
+    if (address_frame && (g_UART_nodeAddress != UART_NO_ADDRESS)) {
+        // Listen to the data frames that follow only if they are for this node
+        UART_WRITE_UCSRA(1 << MPCM_bitNum,
+                ((data != g_UART_nodeAddress) && (data != UART_BROADCAST_ADDRESS)) << MPCM_bitNum);
+        return;
+    }
+
+    next = (g_UART_rxHead + 1) & (UART_RX_BUFFER_SIZE - 1);
+    if (next != g_UART_rxTail) {
+        g_UART_rxBuffer[g_UART_rxHead] = data;
+        g_UART_rxHead = next;
+        COUNT_SATURATED(g_UART_stats.bytes_received);
+#if UART_FLOW_CONTROL
+        if (((next - g_UART_rxTail) & (UART_RX_BUFFER_SIZE - 1)) >= UART_RX_STOP_LEVEL) {
+            GPIO_writePinInline(UART_RTS_PORT_ID, UART_RTS_PIN_ID, LOGIC_HIGH); // Ask the peer to pause
+        }
+#endif
+    } else {
+        COUNT_SATURATED(g_UART_stats.rx_overflows);
+    }
+}
+
+// Move the next queued byte to UDR, or stop the UDRE interrupt when nothing is left
+static inline void UART_txHandler(void) {
+    uint8 tail = g_UART_txTail;
+
+#if UART_FLOW_CONTROL
+    if (GPIO_readPinInline(UART_CTS_PORT_ID, UART_CTS_PIN_ID) == LOGIC_HIGH) {
+        UCSRB_REG.Bits.UDRIE_Bit = LOGIC_LOW; // The peer can't take more, INT0 restarts
+        return;
+    }
+#endif
+    if (tail != g_UART_txHead) {
+        UDR_REG = g_UART_txBuffer[tail];
+        g_UART_txTail = (tail + 1) & (UART_TX_BUFFER_SIZE - 1);
+        COUNT_SATURATED(g_UART_stats.bytes_sent);
+    } else {
+        UCSRB_REG.Bits.UDRIE_Bit = LOGIC_LOW;
+    }
+}
+
+/*
+ * The blocking calls may still be used from interrupt context (timer callbacks),
+ * where the RXC/UDRE interrupts cannot run: service the hardware flags directly.
+ */
+static inline void UART_serviceIfInterruptsDisabled(void) {
+    if (BIT_IS_CLEAR(UART_SREG_REG, UART_SREG_I_bitNum)) {
+        if (UCSRA_REG.Bits.RXC_Bit) {
+            UART_rxHandler();
+        }
+        if (UCSRA_REG.Bits.UDRE_Bit && UCSRB_REG.Bits.UDRIE_Bit) {
+            UART_txHandler();
+        }
+#if UART_FLOW_CONTROL
+        UART_ctsHandler(); // INT0 can't run either
+#endif
+    }
+}
+
+/*
+ * One step of a wait, returns TRUE once timeout_ms have passed since start_ms
+ * (system tick). With interrupts disabled the tick stops: the polling time is
+ * counted in *polled_us instead, so the wait stays bounded in both cases.
+ */
+static boolean UART_waitExpired(uint32 start_ms, uint16 timeout_ms, uint32 *polled_us) {
+    if (BIT_IS_CLEAR(UART_SREG_REG, UART_SREG_I_bitNum)) {
+        if (*polled_us >= (uint32)timeout_ms * 1000UL) {
+            return TRUE;
+        }
+        UART_serviceIfInterruptsDisabled();
+        _delay_us(UART_TIMEOUT_POLL_US);
+        *polled_us += UART_TIMEOUT_POLL_US;
+        return FALSE;
+    }
+    return ((Timer_nowMs() - start_ms) >= timeout_ms);
+}
+
+// Wait for a byte until timeout_ms have passed since start_ms
+static UART_StatusType UART_waitByte(uint8 *data, uint32 start_ms, uint16 timeout_ms,
+        uint32 *polled_us) {
+    while (!UART_tryReceive(data)) {
+        if (UART_waitExpired(start_ms, timeout_ms, polled_us)) {
+            return UART_TIMEOUT;
+        }
+    }
+
+    return UART_OK;
+}
 
 /*******************************************************************************
  * Function: UART_init
@@ -31,15 +197,22 @@ uint8 volatile g_UART_UDRvalue;           // Value received in UDR
  *  UART_ConfigType* UART_ConfigType - Pointer to the UART configuration structure.
  *******************************************************************************/
 void UART_init(UART_ConfigType* UART_ConfigType) {
-    // Set double speed mode
-    UCSRA_REG.Bits.U2X_Bit = LOGIC_HIGH;
+    // Double speed mode if the baud rate setting asks for it
+    UART_WRITE_UCSRA(1 << U2X_bitNum,
+            ((UART_ConfigType->baud_setting & UART_BAUD_U2X_FLAG) != 0) << U2X_bitNum);
 
     // Enable receiver and transmitter
     UCSRB_REG.Bits.RXEN_Bit = LOGIC_HIGH;
     UCSRB_REG.Bits.TXEN_Bit = LOGIC_HIGH;
 
-    // Set character size
+    // Set character size (UCSZ2 is in UCSRB, only set for 9-bit frames)
     UCSRC_REG.Byte |= (1 << URSEL_bitNum) | ((UART_ConfigType->char_size & 0x03) << UCSZ0_bitNum);
+    UCSRB_REG.Bits.UCSZ2_Bit = GET_BIT(UART_ConfigType->char_size, 2);
+
+    // Multi-drop bus: ignore the data frames until an address frame selects this node
+    g_UART_nodeAddress = (UART_ConfigType->char_size == NINE_BITS) ?
+            UART_ConfigType->node_address : UART_NO_ADDRESS;
+    UART_WRITE_UCSRA(1 << MPCM_bitNum, (g_UART_nodeAddress != UART_NO_ADDRESS) << MPCM_bitNum);
 
     // Set parity mode
     UCSRC_REG.Byte |= (1 << URSEL_bitNum) | ((UART_ConfigType->parity_mode & 0x03) << UPM0_bitNum);
@@ -50,38 +223,202 @@ void UART_init(UART_ConfigType* UART_ConfigType) {
     // Set the stop bit based on the provided configuration
     UCSRC_REG.Bits.USBS_Bit = GET_BIT(UART_ConfigType->stop_bit, 0);
 
-    #ifdef UART_RECIVE_INTERRUPT
-    // Enable receive interrupt
+    // Start with empty ring buffers
+    g_UART_rxHead = g_UART_rxTail = 0;
+    g_UART_txHead = g_UART_txTail = 0;
+    g_UART_lineErrors = 0;
+    UART_clearStats();
+
+    // Enable receive interrupt (UDR empty interrupt is enabled when data is queued)
     UCSRB_REG.Bits.RXCIE_Bit = LOGIC_HIGH;
-    #endif
 
-    #ifdef UART_UDR_EMPTY_INTERRUPT
-    // Enable UDR empty interrupt
-    UCSRB_REG.Bits.UDRIE_Bit = LOGIC_HIGH;
-    #endif
+#if UART_FLOW_CONTROL
+    // RTS low: ready to receive. CTS pulled up (no peer: don't send), INT0 on its edges
+    GPIO_writePinInline(UART_RTS_PORT_ID, UART_RTS_PIN_ID, LOGIC_LOW);
+    GPIO_setupPinDirectionInline(UART_RTS_PORT_ID, UART_RTS_PIN_ID, PIN_OUTPUT);
+    GPIO_setupPinDirectionInline(UART_CTS_PORT_ID, UART_CTS_PIN_ID, PIN_INPUT);
+    GPIO_writePinInline(UART_CTS_PORT_ID, UART_CTS_PIN_ID, LOGIC_HIGH);
+    UART_MCUCR_REG = (uint8)((UART_MCUCR_REG & ~(3 << UART_ISC00_bitNum)) | (1 << UART_ISC00_bitNum));
+    UART_GIFR_REG = (1 << UART_INT0_bitNum); // Clear a stale flag (written with one)
+    UART_GICR_REG |= (1 << UART_INT0_bitNum);
+#endif
 
-    // Calculate the baud rate register value
-    uint16 ubrr_value = (uint16)(((F_CPU / (UART_ConfigType->baud_rate * 8UL))) - 1);
+    // Baud rate register value, worked out at compile time by UART_BAUD_SETTING
+    uint16 ubrr_value = UART_ConfigType->baud_setting & UART_MAX_UBRR;
+    g_UART_baudSetting = UART_ConfigType->baud_setting;
     UBRRL_REG = ubrr_value;    // Set low byte of baud rate
     UBRRH_REG = ubrr_value >> 8; // Set high byte of baud rate
 }
 
+/*******************************************************************************
+ * Function: UART_setBaud
+ *
+ * Description:
+ * Changes the baud rate once the queued bytes are sent at the old rate.
+ *
+ * Parameters:
+ *  uint16 baud_setting - UART_BAUD_SETTING of the new baud rate.
+ *  uint16 timeout_ms   - Longest time to wait for the queued bytes.
+ *
+ * Returns:
+ *  UART_StatusType - UART_OK if the rate was changed, UART_TIMEOUT if the
+ *                    queued bytes were not sent in time (dropped, rate kept).
+ *******************************************************************************/
+UART_StatusType UART_setBaud(uint16 baud_setting, uint16 timeout_ms) {
+    uint32 start_ms = Timer_nowMs();
+    uint32 polled_us = 0;
+    uint16 ubrr_value;
+    uint32 frame_cycles;
+    uint32 waited_cycles;
+    uint8 sreg;
+
+    // Let the TX ring buffer and UDR drain, the peer may hold them back with CTS
+    while ((g_UART_txHead != g_UART_txTail) || !UCSRA_REG.Bits.UDRE_Bit) {
+        if (UART_waitExpired(start_ms, timeout_ms, &polled_us)) {
+            sreg = UART_SREG_REG;
+            cli(); // INT0 (CTS) restarts the UDRE interrupt while bytes are queued
+            UCSRB_REG.Bits.UDRIE_Bit = LOGIC_LOW;
+            g_UART_txTail = g_UART_txHead;
+            UART_SREG_REG = sreg;
+            return UART_TIMEOUT;
+        }
+    }
+
+    // The last byte is still in the shift register: wait one frame at the old rate
+    frame_cycles = (uint32)UART_MAX_FRAME_BITS * ((g_UART_baudSetting & UART_MAX_UBRR) + 1)
+            * ((g_UART_baudSetting & UART_BAUD_U2X_FLAG) ? 8 : 16);
+    for (waited_cycles = 0; waited_cycles < frame_cycles;
+            waited_cycles += (F_CPU / 1000000UL) * UART_TIMEOUT_POLL_US) {
+        _delay_us(UART_TIMEOUT_POLL_US);
+    }
+
+    g_UART_baudSetting = baud_setting;
+    UART_WRITE_UCSRA(1 << U2X_bitNum, ((baud_setting & UART_BAUD_U2X_FLAG) != 0) << U2X_bitNum);
+    ubrr_value = baud_setting & UART_MAX_UBRR;
+    UBRRH_REG = ubrr_value >> 8; // URSEL is 0: the write goes to UBRRH
+    UBRRL_REG = ubrr_value;      // Writing UBRRL updates the prescaler
+
+    // Bytes received at the old rate are garbage at the new one
+    g_UART_rxTail = g_UART_rxHead;
+    g_UART_lineErrors = 0;
+#if UART_FLOW_CONTROL
+    GPIO_writePinInline(UART_RTS_PORT_ID, UART_RTS_PIN_ID, LOGIC_LOW);
+#endif
+
+    return UART_OK;
+}
+
+/*******************************************************************************
+ * Function: UART_lineErrors
+ *
+ * Description:
+ * Returns the number of bytes received with a frame error or an overrun.
+ *******************************************************************************/
+uint8 UART_lineErrors(void) {
+    return g_UART_lineErrors;
+}
+
+/*******************************************************************************
+ * Function: UART_clearLineErrors
+ *
+ * Description:
+ * Starts the line error count again from 0.
+ *******************************************************************************/
+void UART_clearLineErrors(void) {
+    g_UART_lineErrors = 0;
+}
+
+/*******************************************************************************
+ * Function: UART_getStats
+ *
+ * Description:
+ * Copies the link quality counters, with the RXC/UDRE interrupts held off.
+ *
+ * Parameters:
+ *  UART_StatsType *stats - Pointer to store the counters.
+ *******************************************************************************/
+void UART_getStats(UART_StatsType *stats) {
+    uint8 sreg = UART_SREG_REG;
+
+    cli(); // 16-bit counters, updated by the interrupts
+    *stats = g_UART_stats;
+    UART_SREG_REG = sreg;
+}
+
+/*******************************************************************************
+ * Function: UART_clearStats
+ *
+ * Description:
+ * Starts the link quality counters again from 0.
+ *******************************************************************************/
+void UART_clearStats(void) {
+    static const UART_StatsType zero = { 0 };
+    uint8 sreg = UART_SREG_REG;
+
+    cli();
+    g_UART_stats = zero;
+    UART_SREG_REG = sreg;
+}
+
 /*******************************************************************************
  * Function: UART_sendByte
  *
  * Description:
- * Sends a single byte via UART. Waits until the UDR is empty before sending.
+ * Queues a single byte for transmission. Waits only while the TX ring buffer
+ * is full.
  *
  * Parameters:
  *  const uint8 data - The byte to send.
  *******************************************************************************/
-#ifdef UART_UDR_EMPTY_POLLING
 void UART_sendByte(const uint8 data) {
-    // Wait until UDR is empty
-    while (!UCSRA_REG.Bits.UDRE_Bit) {};
+    uint8 next = (g_UART_txHead + 1) & (UART_TX_BUFFER_SIZE - 1);
+
+    // Wait until there is room in the TX ring buffer
+    while (next == g_UART_txTail) {
+        UART_serviceIfInterruptsDisabled();
+    }
+
+    g_UART_txBuffer[g_UART_txHead] = data;
+    g_UART_txHead = next;
+
+    // Let the UDRE interrupt drain the buffer
+    UCSRB_REG.Bits.UDRIE_Bit = LOGIC_HIGH;
+}
+
+/*******************************************************************************
+ * Function: UART_write
+ *
+ * Description:
+ * Queues up to len bytes for transmission without waiting.
+ *
+ * Parameters:
+ *  const uint8 *buf - Pointer to the bytes to send.
+ *  uint8 len        - Number of bytes to send.
+ *
+ * Returns:
+ *  uint8 - Number of bytes queued, less than len if the TX buffer got full.
+ *******************************************************************************/
+uint8 UART_write(const uint8 *buf, uint8 len) {
+    uint8 count = 0;
+    uint8 head = g_UART_txHead;
+    uint8 next;
+
+    while (count < len) {
+        next = (head + 1) & (UART_TX_BUFFER_SIZE - 1);
+        if (next == g_UART_txTail) {
+            break; // TX buffer is full
+        }
+        g_UART_txBuffer[head] = buf[count];
+        head = next;
+        count++;
+    }
+
+    if (count) {
+        g_UART_txHead = head;
+        UCSRB_REG.Bits.UDRIE_Bit = LOGIC_HIGH; // Start draining the buffer
+    }
 
-    // Load data into UDR for transmission
-    UDR_REG = data;
+    return count;
 }
 
 /*******************************************************************************
@@ -100,73 +437,167 @@ void UART_sendString(const uint8 *Str) {
         Str++; // Move to the next character
     }
 }
-#endif
 
 /*******************************************************************************
  * Function: UART_recieveByte
  *
  * Description:
- * Receives a single byte via UART. Waits until data is received.
+ * Receives a single byte via UART. Waits until a byte is available in the
+ * RX ring buffer.
  *
  * Returns:
  *  uint8 - The received byte.
  *******************************************************************************/
-#ifdef UART_RECIEVE_POLLING
 uint8 UART_recieveByte(void) {
+    uint8 data;
+
     // Wait until data is received
-    while (!UCSRA_REG.Bits.RXC_Bit);
+    while (!UART_tryReceive(&data)) {
+        UART_serviceIfInterruptsDisabled();
+    }
 
-    // Return the received byte from UDR
-    return UDR_REG;
+    return data;
+}
+
+/*******************************************************************************
+ * Function: UART_receiveByteTimeout
+ *
+ * Description:
+ * Receives a single byte via UART, waiting at most timeout_ms.
+ *
+ * Parameters:
+ *  uint8 *data       - Pointer to store the received byte.
+ *  uint16 timeout_ms - Longest time to wait, in milliseconds.
+ *
+ * Returns:
+ *  UART_StatusType - UART_OK if a byte was received, UART_TIMEOUT otherwise.
+ *******************************************************************************/
+UART_StatusType UART_receiveByteTimeout(uint8 *data, uint16 timeout_ms) {
+    uint32 polled_us = 0;
+
+    return UART_waitByte(data, Timer_nowMs(), timeout_ms, &polled_us);
+}
+
+/*******************************************************************************
+ * Function: UART_tryReceive
+ *
+ * Description:
+ * Takes the oldest byte from the RX ring buffer without waiting.
+ *
+ * Parameters:
+ *  uint8 *data - Pointer to store the received byte.
+ *
+ * Returns:
+ *  boolean - TRUE if a byte was received, FALSE if the buffer is empty.
+ *******************************************************************************/
+boolean UART_tryReceive(uint8 *data) {
+    uint8 tail = g_UART_rxTail;
+
+    if (tail == g_UART_rxHead) {
+        return FALSE; // Nothing received
+    }
+
+    *data = g_UART_rxBuffer[tail];
+    tail = (tail + 1) & (UART_RX_BUFFER_SIZE - 1);
+    g_UART_rxTail = tail;
+
+#if UART_FLOW_CONTROL
+    // Let the peer go on once the buffer is read down (RTS is only set by the RXC interrupt)
+    if (((g_UART_rxHead - tail) & (UART_RX_BUFFER_SIZE - 1)) <= UART_RX_RESUME_LEVEL) {
+        GPIO_writePinInline(UART_RTS_PORT_ID, UART_RTS_PIN_ID, LOGIC_LOW);
+    }
+#endif
+
+    return TRUE;
+}
+
+/*******************************************************************************
+ * Function: UART_available
+ *
+ * Description:
+ * Returns the number of bytes waiting in the RX ring buffer.
+ *******************************************************************************/
+uint8 UART_available(void) {
+    return (g_UART_rxHead - g_UART_rxTail) & (UART_RX_BUFFER_SIZE - 1);
 }
 
 /*******************************************************************************
  * Function: UART_receiveString
  *
  * Description:
- * Receives a string of characters until the '#' symbol is encountered.
+ * Receives a string of characters until the '#' symbol is encountered, in at
+ * most timeout_ms. Characters that don't fit in the buffer are dropped.
  *
  * Parameters:
- *  uint8 *Str - Pointer to the buffer to store the received string.
+ *  uint8 *Str        - Pointer to the buffer to store the received string.
+ *  uint8 size        - Size of the buffer, including the null terminator.
+ *  uint16 timeout_ms - Longest time to wait for the whole string, in milliseconds.
+ *
+ * Returns:
+ *  UART_StatusType - UART_OK, UART_TIMEOUT or UART_TOO_LONG.
  *******************************************************************************/
-void UART_receiveString(uint8 *Str) {
+UART_StatusType UART_receiveString(uint8 *Str, uint8 size, uint16 timeout_ms) {
+    UART_StatusType status = UART_OK;
+    uint32 start_ms = Timer_nowMs();
+    uint32 polled_us = 0;
+    uint8 data;
     uint8 i = 0;
 
-    // Receive the first byte
-    Str[i] = UART_recieveByte();
+    // Receive until '#' is encountered, keeping room for the null terminator
+    for (;;) {
+        if (UART_waitByte(&data, start_ms, timeout_ms, &polled_us) != UART_OK) {
+            status = UART_TIMEOUT;
+            break;
+        }
+        if (data == '#') {
+            break;
+        }
+        if ((i + 1) < size) {
+            Str[i] = data;
+            i++;
+        } else {
+            status = UART_TOO_LONG; // Keep reading up to '#' to stay in step
+        }
+    }
 
-    // Continue receiving until '#' is encountered
-    while (Str[i] != '#') {
-        i++; // Increment index
-        Str[i] = UART_recieveByte(); // Receive next byte
+    if (size != 0) {
+        Str[i] = '\0'; // Null-terminate the string
     }
 
-    Str[i] = '\0'; // Null-terminate the string
+    return status;
 }
-#endif
 
 /*******************************************************************************
  * Interrupt Service Routine: USART_RXC_vect
  *
  * Description:
- * Handles the receive complete interrupt. Sets the receive flag and stores
- * the received byte in a global variable.
+ * Handles the receive complete interrupt. Stores the received byte in the
+ * RX ring buffer.
  *******************************************************************************/
-#ifdef UART_RECIVE_INTERRUPT
 ISR(USART_RXC_vect) {
-    g_UART_recieve_flag = 1; // Set the receive flag
-    g_UART_UDRvalue = UDR_REG; // Store the received byte
+    UART_rxHandler();
 }
-#endif
 
 /*******************************************************************************
  * Interrupt Service Routine: USART_UDRE_vect
  *
  * Description:
- * Handles the UDR empty interrupt. Sets the UDR empty flag.
+ * Handles the UDR empty interrupt. Sends the next byte of the TX ring buffer
+ * and disables itself once the buffer is empty.
  *******************************************************************************/
-#ifdef UART_UDR_EMPTY_INTERRUPT
 ISR(USART_UDRE_vect) {
-    g_UART_UDR_EMP_flag = 1; // Set the UDR empty flag
+    UART_txHandler();
+}
+
+#if UART_FLOW_CONTROL
+/*******************************************************************************
+ * Interrupt Service Routine: INT0_vect
+ *
+ * Description:
+ * Handles the edges of the CTS input. Restarts the sending of the TX ring
+ * buffer once the peer is ready again.
+ *******************************************************************************/
+ISR(INT0_vect) {
+    UART_ctsHandler();
 }
 #endif
@@ -14,25 +14,96 @@
 #define UART_H_
 
 #include "../imp_files/std_types.h" // Include standard types header
+#include "../imp_files/io_access.h" // Include register address header
 
 /*******************************************************************************
  *                                Definitions                                  *
  *******************************************************************************/
 
 // Register definitions for UART control and data
-#define UCSRA_REG  (*(volatile  UART_UCSRA_Type*) 0x2B ) // UART Control and Status Register A
-#define UCSRB_REG  (*(volatile  UART_UCSRB_Type*) 0x2A) // UART Control and Status Register B
-#define UCSRC_REG  (*(volatile  UART_UCSRC_Type*) 0x40) // UART Control and Status Register C
-#define UDR_REG    (*(volatile  uint8*) 0x2C)             // UART Data Register
+#define UCSRA_REG  (*(volatile  UART_UCSRA_Type*) IO_ADDRESS(0x2B) ) // UART Control and Status Register A
+#define UCSRB_REG  (*(volatile  UART_UCSRB_Type*) IO_ADDRESS(0x2A)) // UART Control and Status Register B
+#define UCSRC_REG  (*(volatile  UART_UCSRC_Type*) IO_ADDRESS(0x40)) // UART Control and Status Register C
+#ifdef HMI_SIMULATION
+// One byte wider in the simulation: a write clears the high byte, so the simulated UART can tell writes from reads
+#define UDR_REG    (*(volatile  uint16*) IO_ADDRESS(0x2C))            // UART Data Register
+#else
+#define UDR_REG    (*(volatile  uint8*) IO_ADDRESS(0x2C))             // UART Data Register
+#endif
 
-// Uncomment for different receive modes
-#define UART_RECIEVE_POLLING // Polling mode for receiving
-//#define UART_RECIVE_INTERRUPT // Interrupt mode for receiving
+// Ring buffer sizes filled/drained by the RXC and UDRE interrupts (power of two, max 128)
+#define UART_RX_BUFFER_SIZE 32 // Receive ring buffer size in bytes
+#define UART_TX_BUFFER_SIZE 32 // Transmit ring buffer size in bytes
 
-#define UART_UDR_EMPTY_POLLING // Polling mode to check if UDR is empty
+#if ((UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1)) != 0) || (UART_RX_BUFFER_SIZE > 128)
+#error "UART_RX_BUFFER_SIZE should be a power of two and not more than 128"
+#endif
 
-#define UBRRL_REG  (*(volatile  uint8*) 0x29) // UART Baud Rate Register Low
-#define UBRRH_REG  (*(volatile  uint8*) 0x40) // UART Baud Rate Register High
+#if ((UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) != 0) || (UART_TX_BUFFER_SIZE > 128)
+#error "UART_TX_BUFFER_SIZE should be a power of two and not more than 128"
+#endif
+
+/*
+ * Optional RTS/CTS flow control on GPIO pins (the USART has none), 1 to enable.
+ * RTS (output, low: send to me) goes high once UART_RX_STOP_LEVEL bytes wait
+ * in the RX ring buffer, and low again when the application has read them
+ * down to UART_RX_RESUME_LEVEL. The room above UART_RX_STOP_LEVEL takes the
+ * bytes the peer already started. CTS (input on INT0, low: go on) comes from
+ * the peer: while it is high the bytes stay in the TX ring buffer, and its
+ * falling edge restarts the sending.
+ */
+#ifndef UART_FLOW_CONTROL
+#define UART_FLOW_CONTROL 0
+#endif
+
+#define UART_RTS_PORT_ID     PORTC_ID
+#define UART_RTS_PIN_ID      PIN3_ID
+#define UART_CTS_PORT_ID     PORTD_ID  // INT0
+#define UART_CTS_PIN_ID      PIN2_ID
+
+#define UART_RX_STOP_LEVEL   (UART_RX_BUFFER_SIZE - 8)
+#define UART_RX_RESUME_LEVEL (UART_RX_BUFFER_SIZE / 4)
+
+/*
+ * Compile-time baud rate settings from F_CPU, for constant baud rates (usable
+ * in #if, so a baud rate the UART can't produce fails the build):
+ *  UART_UBRR        UBRR of the rate in normal (u2x = 0) or double speed mode, rounded
+ *  UART_BAUD_ERROR  baud rate error of that UBRR, in 0.1%
+ *  UART_U2X         1 if double speed mode gives a smaller error (normal mode
+ *                   samples each bit more times, so it wins ties)
+ *  UART_BAUD_OK     the rate is within UART_MAX_BAUD_ERROR
+ *  UART_BAUD_SETTING  UBRR and U2X of the rate, for UART_ConfigType
+ */
+#define UART_MAX_BAUD_ERROR 20 // 2%
+#define UART_MAX_UBRR       4095
+#define UART_BAUD_U2X_FLAG  0x8000
+
+#define UART_DIVISOR(baud, u2x)   (((u2x) ? 8UL : 16UL) * (baud))
+#define UART_UBRR(baud, u2x)      ((F_CPU + UART_DIVISOR(baud, u2x) / 2) / UART_DIVISOR(baud, u2x) - 1)
+#define UART_BAUD_ACTUAL(baud, u2x) ((F_CPU) / (((u2x) ? 8UL : 16UL) * (UART_UBRR(baud, u2x) + 1)))
+#define UART_BAUD_ERROR(baud, u2x) \
+	(((UART_BAUD_ACTUAL(baud, u2x) > (baud)) ? (UART_BAUD_ACTUAL(baud, u2x) - (baud)) : \
+	  ((baud) - UART_BAUD_ACTUAL(baud, u2x))) * 1000UL / (baud))
+#define UART_U2X(baud) \
+	((UART_UBRR(baud, 1) <= UART_MAX_UBRR) && (UART_BAUD_ERROR(baud, 0) > UART_BAUD_ERROR(baud, 1)))
+#define UART_BAUD_OK(baud) \
+	((UART_UBRR(baud, UART_U2X(baud)) <= UART_MAX_UBRR) \
+	 && (UART_BAUD_ERROR(baud, UART_U2X(baud)) <= UART_MAX_BAUD_ERROR))
+#define UART_BAUD_SETTING(baud) \
+	((uint16)(UART_UBRR(baud, UART_U2X(baud)) | (UART_U2X(baud) ? UART_BAUD_U2X_FLAG : 0)))
+
+// Multi-drop bus (9-bit frames): node_address of a point-to-point link, and address that selects every node
+#define UART_NO_ADDRESS        0x00
+#define UART_BROADCAST_ADDRESS 0xFF
+
+// Polling step of the timeout-aware receive calls when interrupts are disabled (system tick stopped)
+#define UART_TIMEOUT_POLL_US 50
+
+// Longest frame (start bit, 9 data bits, parity, 2 stop bits), waited for by UART_setBaud
+#define UART_MAX_FRAME_BITS 13
+
+#define UBRRL_REG  (*(volatile  uint8*) IO_ADDRESS(0x29)) // UART Baud Rate Register Low
+#define UBRRH_REG  (*(volatile  uint8*) IO_ADDRESS(0x40)) // UART Baud Rate Register High
 
 #define URSEL_bitNum 7 // URSEL bit number in UCSRC
 
@@ -41,10 +112,8 @@
 
 #define UPM0_bitNum 4  // UPM0 bit number in UCSRC
 
-// Global flags for UART operation
-extern uint8 volatile g_UART_recieve_flag; // Flag for UART receive status
-extern uint8 volatile g_UART_UDR_EMP_flag; // Flag for UDR empty status
-extern uint8 volatile g_UART_UDRvalue; // Value received in UDR
+#define MPCM_bitNum 0  // MPCM bit number in UCSRA
+#define U2X_bitNum 1   // U2X bit number in UCSRA
 
 /*******************************************************************************
  *                      Types Declaration                                    *
@@ -65,12 +134,30 @@ typedef enum {
 	FIVE_BITS, SIX_BITS, SEVEN_BITS, EIGHT_BITS, R1, R2, R3, NINE_BITS
 } UART_charsize;
 
+// Result of the timeout-aware calls
+typedef enum {
+	UART_OK,        // Received (or sent) completely
+	UART_TIMEOUT,   // Nothing more received, or the queued bytes not sent, before the timeout
+	UART_TOO_LONG   // String longer than the buffer, the rest was dropped up to '#'
+} UART_StatusType;
+
+// Link quality counters since UART_init or UART_clearStats, each saturates at 0xFFFF
+typedef struct {
+	uint16 bytes_received;  // Bytes stored in the RX ring buffer
+	uint16 bytes_sent;      // Bytes moved to UDR
+	uint16 overruns;        // Bytes received after lost ones (DOR: UDR not read in time)
+	uint16 frame_errors;    // Bytes received with a missing stop bit (FE)
+	uint16 parity_errors;   // Bytes received with a wrong parity bit (PE)
+	uint16 rx_overflows;    // Bytes dropped because the RX ring buffer was full
+} UART_StatsType;
+
 // Configuration structure for UART settings
 typedef struct {
 	UART_charsize char_size;   // Character size
 	UART_paritymode parity_mode; // Parity mode
 	UART_stopbit stop_bit;      // Stop bit configuration
-	uint32 baud_rate;           // Baud rate
+	uint16 baud_setting;        // UART_BAUD_SETTING(baud rate), check it with UART_BAUD_OK
+	uint8 node_address;         // Address on a multi-drop bus (NINE_BITS only), UART_NO_ADDRESS otherwise
 } UART_ConfigType;
 
 // Union for UCSRA register representation
@@ -127,22 +214,93 @@ typedef union {
  * Initialize the UART device by:
  * 1. Setting up the frame format (data bits, parity, stop bits).
  * 2. Enabling the UART.
- * 3. Configuring the UART baud rate.
+ * 3. Configuring the UART baud rate (worked out at compile time).
+ * With NINE_BITS and a node_address, the UART joins a multi-drop bus in
+ * multi-processor mode: the ninth bit marks address frames, and the data
+ * frames that follow an address of another node are dropped by the hardware
+ * (no interrupt). Only the 8 data bits are buffered, and the bytes sent are
+ * data frames (ninth bit cleared).
  */
 void UART_init(UART_ConfigType* UART_ConfigType);
 
+/*
+ * Description :
+ * Change the baud rate at run time (baud_setting from UART_BAUD_SETTING).
+ * Waits at most timeout_ms until the queued bytes are sent at the old rate,
+ * and drops the bytes received but not read yet. The line error count starts
+ * again from 0. Returns UART_TIMEOUT if the bytes were not sent in time (the
+ * peer holds CTS high): they are dropped and the old rate is kept.
+ */
+UART_StatusType UART_setBaud(uint16 baud_setting, uint16 timeout_ms);
+
+/*
+ * Description :
+ * Return the number of bytes received with a frame error or a data overrun
+ * (FE/DOR) since UART_init, UART_setBaud or UART_clearLineErrors. Repeated
+ * errors mean the two ends don't run at the same baud rate.
+ */
+uint8 UART_lineErrors(void);
+
+/*
+ * Description :
+ * Start the line error count again from 0, e.g. after a valid frame.
+ */
+void UART_clearLineErrors(void);
+
+/*
+ * Description :
+ * Copy the link quality counters to stats (read with interrupts disabled, so
+ * the counters are consistent with each other).
+ */
+void UART_getStats(UART_StatsType *stats);
+
+/*
+ * Description :
+ * Start the link quality counters again from 0.
+ */
+void UART_clearStats(void);
+
 /*
  * Description :
  * Send a byte to another UART device.
+ * The byte is queued in the TX ring buffer, waits only if the buffer is full.
  */
 void UART_sendByte(const uint8 data);
 
 /*
  * Description :
  * Receive a byte from another UART device.
+ * Waits until a byte is available in the RX ring buffer.
  */
 uint8 UART_recieveByte(void);
 
+/*
+ * Description :
+ * Receive a byte, waiting at most timeout_ms.
+ * Returns UART_OK and stores the byte in data, or UART_TIMEOUT.
+ */
+UART_StatusType UART_receiveByteTimeout(uint8 *data, uint16 timeout_ms);
+
+/*
+ * Description :
+ * Non-blocking receive: take the oldest byte from the RX ring buffer.
+ * Returns TRUE and stores the byte in data, or FALSE if no byte is available.
+ */
+boolean UART_tryReceive(uint8 *data);
+
+/*
+ * Description :
+ * Non-blocking send: queue up to len bytes from buf in the TX ring buffer.
+ * Returns the number of bytes actually queued (less than len if the buffer is full).
+ */
+uint8 UART_write(const uint8 *buf, uint8 len);
+
+/*
+ * Description :
+ * Return the number of received bytes waiting in the RX ring buffer.
+ */
+uint8 UART_available(void);
+
 /*
  * Description :
  * Send a string through UART to another device.
@@ -151,8 +309,12 @@ void UART_sendString(const uint8 *Str);
 
 /*
  * Description :
- * Receive a string until the '#' symbol from another UART device.
+ * Receive a string until the '#' symbol from another UART device, in at most
+ * timeout_ms. At most size - 1 characters are stored, always null-terminated.
+ * Returns UART_OK, UART_TIMEOUT (Str holds what was received) or UART_TOO_LONG
+ * (Str holds the first size - 1 characters, the rest up to '#' is dropped so
+ * the next call starts on the next string).
  */
-void UART_receiveString(uint8 *Str); // Receive until '#' symbol
+UART_StatusType UART_receiveString(uint8 *Str, uint8 size, uint16 timeout_ms);
 
 #endif /* UART_H_ */
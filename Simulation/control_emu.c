@@ -0,0 +1,344 @@
+/******************************************************************************
+ *
+ * Module: Control ECU stand-in
+ *
+ * File Name: control_emu.c
+ *
+ * Description: Control side of the HMI <-> Control link for the host
+ *              simulation, with configurable delays and line errors
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+/*
+ * Started by hmi_sim -c with stdin/stdout on one end of a socketpair. The two
+ * programs run in lockstep on the simulated time, so runs are repeatable:
+ *
+ *   hmi_sim -> control_emu
+ *     B <time_us> <hex>     the HMI finished sending one byte
+ *     F <time_us> <hex>     same, received with a frame error (baud rates apart)
+ *     T <time_us>           wake-up asked for with W
+ *   control_emu -> hmi_sim, after each message
+ *     S <delay_us> <hex>... send bytes to the HMI, delay_us after the message time
+ *     A <delay_us> <hex>    send an address frame (9-bit multi-drop bus)
+ *     W <delay_us>          send a T message delay_us after the message time
+ *     R <baud>              switch the Control UART, for the bytes sent from now on
+ *     .                     end of the answer
+ */
+
+#include "../HAL_Drivers/Protocol_parser.h"
+#include "../Application/main.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Line error and timing configuration (command line)
+static uint32 g_responseUs = 2000;   // Control processing time before answering
+static uint32 g_jitterUs = 0;        // Random extra delay, 0 .. g_jitterUs
+static uint32 g_peopleMs = 3000;     // Time people take to pass the door, 0: nobody
+static double g_dropRate = 0;        // Probability to lose a byte, both ways
+static double g_corruptRate = 0;     // Probability to flip one bit of a byte, both ways
+static uint32 g_address = 0;         // HMI address on a multi-drop bus, 0: point-to-point link
+static uint32 g_maxBaud = 115200;    // Highest baud rate the Control UART supports
+static uint32 g_statsMs = 0;         // Period of the LINK_STATS requests, 0: never
+
+// Link baud rates by SET_BAUD index, as link_bauds in main.c
+static const uint32 g_bauds[NUM_OF_BAUDS] = { HMI_BAUD_RATE, 19200, 38400, 57600, 115200 };
+static uint8 g_baudIndex = 0;
+static uint32 g_lineErrors = 0;      // Bytes with a frame error since the last valid frame
+
+static Protocol_ParserType g_parser; // Frame parser of the firmware (Protocol_parser.c)
+static unsigned long long g_lastByteUs; // Time of the last byte given to the parser
+
+static uint8 g_password[PASS_SIZE];
+static boolean g_passwordSaved = FALSE;
+static uint8 g_motionSequence;
+static boolean g_peoplePassing = FALSE;
+static unsigned long long g_peopleDoneUs; // Time the people are through
+
+// LINK_STATS requests sent to the HMI
+static uint8 g_txSequence = 0;
+static boolean g_statsStarted = FALSE;
+static unsigned long long g_statsDueUs;
+
+// Names of the LINK_STATS counters, in App_StatType order
+static const char *const g_statNames[NUM_OF_STATS] = {
+    "frames", "bytes", "overruns", "frame errors", "parity errors", "CRC errors",
+    "retransmits", "RX overflows", "frames sent", "cut frames"
+};
+
+// Answer being built for the current message
+static char g_answer[4096];
+static size_t g_answerLength;
+
+// Statistics, printed on exit
+static uint32 g_frames = 0;
+static uint32 g_fallbacks = 0;
+static uint32 g_badFrames = 0;
+static uint32 g_dropped = 0;
+static uint32 g_corrupted = 0;
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+static boolean EMU_chance(double rate) {
+    return (rate > 0) && ((double)rand() / RAND_MAX < rate);
+}
+
+// Apply the line errors to one byte, returns FALSE if the byte is lost
+static boolean EMU_lineError(uint8 *data) {
+    if (EMU_chance(g_dropRate)) {
+        g_dropped++;
+        return FALSE;
+    }
+    if (EMU_chance(g_corruptRate)) {
+        *data ^= (uint8)(1 << (rand() % 8));
+        g_corrupted++;
+    }
+    return TRUE;
+}
+
+static void EMU_answer(const char *format, uint32 value) {
+    g_answerLength += (size_t)snprintf(g_answer + g_answerLength,
+            sizeof(g_answer) - g_answerLength, format, (unsigned long)value);
+}
+
+// Queue a frame for the HMI after the Control processing time
+static void EMU_sendFrame(uint8 command, uint8 sequence, const uint8 *payload, uint8 length) {
+    uint8 bytes[PROTOCOL_MAX_PAYLOAD + 5];
+    uint8 count = 0;
+    uint8 crc = 0;
+    uint32 delay_us = g_responseUs + (g_jitterUs ? (uint32)(rand() % (g_jitterUs + 1)) : 0);
+    uint8 i;
+
+    bytes[count++] = PROTOCOL_START_BYTE;
+    bytes[count++] = command;
+    bytes[count++] = length;
+    bytes[count++] = sequence;
+    for (i = 0; i < length; i++) {
+        bytes[count++] = payload[i];
+    }
+    for (i = 1; i < count; i++) {
+        crc = PROTOCOL_crc8Update(crc, bytes[i]);
+    }
+    bytes[count++] = crc;
+
+    if (g_address) {
+        // Select the HMI first, the frame follows right after the address
+        EMU_answer("A %lu", delay_us);
+        EMU_answer(" %02lX\n", g_address);
+    }
+    EMU_answer("S %lu", delay_us);
+    for (i = 0; i < count; i++) {
+        if (EMU_lineError(&bytes[i])) {
+            EMU_answer(" %02lX", bytes[i]);
+        }
+    }
+    EMU_answer("\n", 0);
+}
+
+// Switch the Control UART once the bytes queued so far are out
+static void EMU_setBaud(uint8 index) {
+    g_baudIndex = index;
+    g_lineErrors = 0;
+    EMU_answer("R %lu\n", g_bauds[index]);
+}
+
+// Print the counters of a LINK_STATS response from the HMI
+static void EMU_printStats(const Protocol_FrameType *frame) {
+    uint8 i;
+
+    if (frame->length != 2 * NUM_OF_STATS) {
+        return;
+    }
+    fprintf(stderr, "control_emu: HMI link at %.3f ms:", g_lastByteUs / 1000.0);
+    for (i = 0; i < NUM_OF_STATS; i++) {
+        fprintf(stderr, "%s %u %s", i ? "," : "",
+                frame->payload[2 * i] | (frame->payload[2 * i + 1] << 8), g_statNames[i]);
+    }
+    fprintf(stderr, "\n");
+}
+
+// What the Control ECU does for each request
+static void EMU_handleFrame(const Protocol_FrameType *frame) {
+    uint8 result;
+
+    g_frames++;
+    g_lineErrors = 0;
+    switch (frame->command) {
+    case SET_BAUD:
+        // Highest rate both support, answered at the current rate
+        if (frame->length != 1) {
+            break;
+        }
+        result = 0;
+        while ((result + 1 < NUM_OF_BAUDS) && (result + 1 <= frame->payload[0])
+                && (g_bauds[result + 1] <= g_maxBaud)) {
+            result++;
+        }
+        EMU_sendFrame(SET_BAUD, frame->sequence, &result, 1);
+        if (result != g_baudIndex) {
+            EMU_setBaud(result);
+        }
+        break;
+    case SAVE_PASS_and_confirm:
+        result = unmatched;
+        if ((frame->length == 2 * PASS_SIZE)
+                && !memcmp(frame->payload, frame->payload + PASS_SIZE, PASS_SIZE)) {
+            memcpy(g_password, frame->payload, PASS_SIZE);
+            g_passwordSaved = TRUE;
+            result = matched;
+        }
+        EMU_sendFrame(frame->command, frame->sequence, &result, 1);
+        break;
+    case OPEN_DOOR:
+    case CHANGE_PASS:
+        result = (g_passwordSaved && (frame->length == PASS_SIZE)
+                && !memcmp(frame->payload, g_password, PASS_SIZE)) ? matched : unmatched;
+        EMU_sendFrame(frame->command, frame->sequence, &result, 1);
+        break;
+    case MOTION_STATUS:
+        result = g_peopleMs ? people_detected : people_notdetected;
+        EMU_sendFrame(MOTION_STATUS, frame->sequence, &result, 1);
+        if ((result == people_detected) && !g_peoplePassing) {
+            // Report once the people went through
+            g_peoplePassing = TRUE;
+            g_peopleDoneUs = g_lastByteUs + g_peopleMs * 1000ULL;
+            EMU_answer("W %lu\n", g_peopleMs * 1000UL);
+        }
+        g_motionSequence = frame->sequence; // Asked again (lost answer): still passing
+        break;
+    case Alarm:
+        EMU_sendFrame(Alarm, frame->sequence, NULL_PTR, 0);
+        break;
+    case LINK_STATS:
+        EMU_printStats(frame);
+        break;
+    default:
+        break;
+    }
+}
+
+// Give one byte to the parser of the firmware, on the simulated time
+static void EMU_parseByte(uint8 data, unsigned long long time_us) {
+    g_lastByteUs = time_us;
+    switch (PROTOCOL_parseByte(&g_parser, data, (uint32)(time_us / 1000))) {
+    case PROTOCOL_PARSE_FRAME:
+        EMU_handleFrame(&g_parser.frame);
+        break;
+    case PROTOCOL_PARSE_CRC_ERROR:
+    case PROTOCOL_PARSE_CUT:
+        g_badFrames++;
+        break;
+    default:
+        break;
+    }
+}
+
+static void EMU_usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [-r us] [-j us] [-p ms] [-d rate] [-c rate] [-S seed] [-a hex] [-b baud] [-i ms]\n"
+            "  -r us    response delay of the Control ECU (2000)\n"
+            "  -j us    random extra response delay, up to this much (0)\n"
+            "  -p ms    time people take to pass the open door, 0 for nobody (3000)\n"
+            "  -d rate  probability of losing a byte, both directions (0)\n"
+            "  -c rate  probability of a bit error in a byte, both directions (0)\n"
+            "  -S seed  seed of the line errors and jitter (1)\n"
+            "  -a hex   address the HMI before each frame (9-bit multi-drop bus)\n"
+            "  -b baud  highest baud rate agreed to with SET_BAUD (115200)\n"
+            "  -i ms    ask the HMI for its link counters every ms and print them (0: never)\n", program);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    char line[256];
+    unsigned long long time_us;
+    unsigned int data;
+    unsigned int seed = 1;
+    int option;
+    uint8 byte;
+
+    while ((option = getopt(argc, argv, "r:j:p:d:c:S:a:b:i:")) != -1) {
+        switch (option) {
+        case 'r':
+            g_responseUs = (uint32)strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            g_jitterUs = (uint32)strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            g_peopleMs = (uint32)strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            g_dropRate = strtod(optarg, NULL);
+            break;
+        case 'c':
+            g_corruptRate = strtod(optarg, NULL);
+            break;
+        case 'a':
+            g_address = (uint32)strtoul(optarg, NULL, 16);
+            break;
+        case 'i':
+            g_statsMs = (uint32)strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            g_maxBaud = (uint32)strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            seed = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            EMU_usage(argv[0]);
+        }
+    }
+    srand(seed);
+
+    while (fgets(line, sizeof(line), stdin)) {
+        g_answerLength = 0;
+        g_answer[0] = '\0';
+        if (sscanf(line, "B %llu %x", &time_us, &data) == 2) {
+            byte = (uint8)data;
+            if (EMU_lineError(&byte)) {
+                EMU_parseByte(byte, time_us);
+            }
+        } else if (sscanf(line, "F %llu %x", &time_us, &data) == 2) {
+            // The HMI runs at another rate: back to HMI_BAUD_RATE after repeated errors
+            EMU_parseByte((uint8)data, time_us);
+            if ((++g_lineErrors >= BAUD_FALLBACK_ERRORS) && (g_baudIndex != 0)) {
+                g_fallbacks++;
+                EMU_setBaud(0);
+            }
+        } else if (sscanf(line, "T %llu", &time_us) == 1) {
+            if (g_peoplePassing && (time_us >= g_peopleDoneUs)) {
+                // People went through: unsolicited status for the HMI waiting on them
+                byte = people_notdetected;
+                g_peoplePassing = FALSE;
+                EMU_sendFrame(MOTION_STATUS, g_motionSequence, &byte, 1);
+            }
+            if (g_statsMs && (time_us >= g_statsDueUs)) {
+                EMU_sendFrame(LINK_STATS, g_txSequence++, NULL_PTR, 0);
+                g_statsDueUs = time_us + g_statsMs * 1000ULL;
+                EMU_answer("W %lu\n", g_statsMs * 1000UL);
+            }
+        }
+        if (g_statsMs && !g_statsStarted) {
+            // First message: start the LINK_STATS requests
+            g_statsStarted = TRUE;
+            g_statsDueUs = time_us + g_statsMs * 1000ULL;
+            EMU_answer("W %lu\n", g_statsMs * 1000UL);
+        }
+        fputs(g_answer, stdout);
+        fputs(".\n", stdout);
+        fflush(stdout);
+    }
+
+    fprintf(stderr, "control_emu: %lu frames, %lu bad frames, %lu bytes dropped, %lu corrupted, "
+            "%lu baud at the end (%lu fallbacks)\n",
+            (unsigned long)g_frames, (unsigned long)g_badFrames, (unsigned long)g_dropped,
+            (unsigned long)g_corrupted, (unsigned long)g_bauds[g_baudIndex],
+            (unsigned long)g_fallbacks);
+    return 0;
+}
@@ -0,0 +1,18 @@
+/******************************************************************************
+ *
+ * File Name: cpufunc.h
+ *
+ * Description: Host simulation replacement for the avr-libc <avr/cpufunc.h>
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef SIM_AVR_CPUFUNC_H_
+#define SIM_AVR_CPUFUNC_H_
+
+/* The simulated pins settle at once */
+#define _NOP()               do {} while (0)
+#define _MemoryBarrier()     __asm__ __volatile__ ("" ::: "memory")
+
+#endif /* SIM_AVR_CPUFUNC_H_ */
@@ -0,0 +1,46 @@
+/******************************************************************************
+ *
+ * File Name: interrupt.h
+ *
+ * Description: Host simulation replacement for the avr-libc <avr/interrupt.h>
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef SIM_AVR_INTERRUPT_H_
+#define SIM_AVR_INTERRUPT_H_
+
+/* Global interrupt enable, kept in the simulated SREG */
+void SIM_sei(void);
+void SIM_cli(void);
+
+#define sei() SIM_sei()
+#define cli() SIM_cli()
+
+/* An interrupt service routine is a plain function called by the simulated CPU */
+#define ISR(vector) void vector(void)
+
+/* ATmega32 interrupt vectors, in priority order */
+void INT0_vect(void);
+void INT1_vect(void);
+void INT2_vect(void);
+void TIMER2_COMP_vect(void);
+void TIMER2_OVF_vect(void);
+void TIMER1_CAPT_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+void TIMER1_OVF_vect(void);
+void TIMER0_COMP_vect(void);
+void TIMER0_OVF_vect(void);
+void SPI_STC_vect(void);
+void USART_RXC_vect(void);
+void USART_UDRE_vect(void);
+void USART_TXC_vect(void);
+void ADC_vect(void);
+void EE_RDY_vect(void);
+void ANA_COMP_vect(void);
+void TWI_vect(void);
+void SPM_RDY_vect(void);
+
+#endif /* SIM_AVR_INTERRUPT_H_ */
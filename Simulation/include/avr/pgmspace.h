@@ -0,0 +1,20 @@
+/******************************************************************************
+ *
+ * File Name: pgmspace.h
+ *
+ * Description: Host simulation replacement for the avr-libc <avr/pgmspace.h>
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef SIM_AVR_PGMSPACE_H_
+#define SIM_AVR_PGMSPACE_H_
+
+/* The host has a single address space: flash data is ordinary const data */
+#define PROGMEM
+#define PGM_P                const char *
+#define PSTR(s)              (s)
+#define pgm_read_byte(address) (*(const unsigned char *)(address))
+
+#endif /* SIM_AVR_PGMSPACE_H_ */
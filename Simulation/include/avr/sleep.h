@@ -0,0 +1,30 @@
+/******************************************************************************
+ *
+ * File Name: sleep.h
+ *
+ * Description: Host simulation replacement for the avr-libc <avr/sleep.h>
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef SIM_AVR_SLEEP_H_
+#define SIM_AVR_SLEEP_H_
+
+/* Jumps the simulated time to the next interrupt */
+void SIM_sleep(void);
+
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_ADC          1
+#define SLEEP_MODE_PWR_DOWN     2
+#define SLEEP_MODE_PWR_SAVE     3
+#define SLEEP_MODE_STANDBY      6
+#define SLEEP_MODE_EXT_STANDBY  7
+
+/* Every mode is simulated as IDLE: the peripherals keep running */
+#define set_sleep_mode(mode) ((void)(mode))
+#define sleep_enable()       do {} while (0)
+#define sleep_disable()      do {} while (0)
+#define sleep_cpu()          SIM_sleep()
+
+#endif /* SIM_AVR_SLEEP_H_ */
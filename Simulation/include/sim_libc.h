@@ -0,0 +1,17 @@
+/******************************************************************************
+ *
+ * File Name: sim_libc.h
+ *
+ * Description: avr-libc extensions used by the drivers but missing from glibc,
+ *              force-included in every file of the simulation build
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef SIM_LIBC_H_
+#define SIM_LIBC_H_
+
+char *itoa(int value, char *string, int radix);
+
+#endif /* SIM_LIBC_H_ */
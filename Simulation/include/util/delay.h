@@ -0,0 +1,20 @@
+/******************************************************************************
+ *
+ * File Name: delay.h
+ *
+ * Description: Host simulation replacement for the avr-libc <util/delay.h>
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef SIM_UTIL_DELAY_H_
+#define SIM_UTIL_DELAY_H_
+
+/* Busy waits only advance the simulated time (interrupts still run) */
+void SIM_delayUs(double us);
+
+#define _delay_us(us) SIM_delayUs(us)
+#define _delay_ms(ms) SIM_delayUs((ms) * 1000.0)
+
+#endif /* SIM_UTIL_DELAY_H_ */
@@ -0,0 +1,139 @@
+/******************************************************************************
+ *
+ * Module: SIM
+ *
+ * File Name: sim.h
+ *
+ * Description: Shared declarations of the host simulation of the HMI board
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include "../imp_files/std_types.h"
+
+/*******************************************************************************
+ *                                Definitions                                  *
+ *******************************************************************************/
+
+/*
+ * The simulation is not cycle accurate: simulated time advances by the busy
+ * waits, the sleeps and SIM_ACCESS_CYCLES for each register access.
+ */
+#define SIM_ACCESS_CYCLES      4
+#define SIM_NEVER              ((uint64)-1)
+#define SIM_US_TO_CYCLES(us)   ((uint64)((us) * (F_CPU / 1000000.0) + 0.5))
+#define SIM_MS_TO_CYCLES(ms)   SIM_US_TO_CYCLES((ms) * 1000.0)
+#define SIM_CYCLES_TO_MS(c)    ((double)(c) / (F_CPU / 1000.0))
+
+/* Data space addresses of the simulated I/O registers */
+#define SIM_IO_SIZE            0x60
+#define SIM_PIN(port)          (0x39 - 3 * (port))
+#define SIM_DDR(port)          (0x3A - 3 * (port))
+#define SIM_PORT(port)         (0x3B - 3 * (port))
+#define SIM_UBRRL              0x29
+#define SIM_UCSRB              0x2A
+#define SIM_UCSRA              0x2B
+#define SIM_UDR                0x2C
+#define SIM_UBRRH_UCSRC        0x40
+#define SIM_OCR2               0x43
+#define SIM_TCNT2              0x44
+#define SIM_TCCR2              0x45
+#define SIM_ICR1               0x46
+#define SIM_OCR1B              0x48
+#define SIM_OCR1A              0x4A
+#define SIM_TCNT1              0x4C
+#define SIM_TCCR1B             0x4E
+#define SIM_TCCR1A             0x4F
+#define SIM_TCNT0              0x52
+#define SIM_TCCR0              0x53
+#define SIM_TIFR               0x58
+#define SIM_TIMSK              0x59
+#define SIM_OCR0               0x5C
+#define SIM_SREG               0x5F
+
+#define SIM_SREG_I_bitNum      7
+
+/*******************************************************************************
+ *                      Types Declaration                                      *
+ *******************************************************************************/
+
+typedef void (*SIM_EventHandlerType)(uint32 arg);
+
+/*******************************************************************************
+ *                      Shared Variables                                       *
+ *******************************************************************************/
+
+/* Register file of the simulated I/O space, indexed by data space address */
+extern uint8 g_simIo[SIM_IO_SIZE];
+
+/* Called with each byte the HMI transmits (the Control ECU side of the link),
+ * frame_error is TRUE if the peer baud rate doesn't match the HMI's */
+extern void (*g_simUartPeer)(uint8 data, boolean frame_error);
+
+/* Called with each byte on the line, in both directions (trace) */
+extern void (*g_simUartMonitor)(boolean transmit, uint8 data);
+
+/* Called each time the LCD content changes */
+extern void (*g_simLcdObserver)(void);
+
+/*******************************************************************************
+ *                      Functions Prototypes                                   *
+ *******************************************************************************/
+
+/* Simulated time and events (sim_io.c) */
+uint64 SIM_now(void);
+void SIM_schedule(uint64 cycle, SIM_EventHandlerType handler, uint32 arg);
+void SIM_cancel(SIM_EventHandlerType handler);
+void SIM_setRealTimeFactor(double factor);
+void SIM_stop(int status);
+boolean SIM_isStopped(void);
+uint32 SIM_interruptCount(void);
+
+/* Timers 0, 1 and 2 (sim_timer.c) */
+void SIM_timerSync(uint16 address);
+void SIM_timerRefresh(uint16 address);
+void SIM_timerAdvance(uint64 cycle);
+uint64 SIM_timerNextCycle(void);
+boolean SIM_timerPending(uint8 flag);
+void SIM_timerAcknowledge(uint8 flag);
+
+/* USART (sim_uart.c) */
+void SIM_uartSync(uint16 address);
+volatile uint8 *SIM_uartRefresh(uint16 address);
+boolean SIM_uartRxPending(void);
+boolean SIM_uartUdrePending(void);
+boolean SIM_uartTxPending(void);
+void SIM_uartTxAcknowledge(void);
+void SIM_uartPeerSend(const uint8 *data, uint8 length, uint64 delay);
+void SIM_uartPeerSendAddress(uint8 address, uint64 delay);
+void SIM_uartSetPeerBaud(uint32 baud);
+uint32 SIM_uartBytesSent(void);
+uint32 SIM_uartBytesReceived(void);
+uint32 SIM_uartHolds(void);
+void SIM_uartPinSync(void);
+void SIM_uartDrive(uint8 port, uint8 *level);
+
+/* HD44780 LCD (sim_lcd.c) */
+void SIM_lcdInit(boolean render);
+void SIM_lcdSync(void);
+void SIM_lcdDrive(uint8 port, uint8 *level);
+void SIM_lcdRender(void);
+boolean SIM_lcdShows(const char *text);
+uint32 SIM_lcdInstructions(void);
+uint32 SIM_lcdViolations(void);
+
+/* Keypad (sim_keypad.c) */
+boolean SIM_keypadPress(char key);
+void SIM_keypadRelease(void);
+void SIM_keypadDrive(uint8 port, uint8 *level);
+void SIM_keypadSync(void);
+uint32 SIM_keypadEarlyReads(void);
+
+/* Control ECU program on the other end of the line (sim_peer.c) */
+void SIM_peerStart(const char *command);
+
+#endif /* SIM_H_ */
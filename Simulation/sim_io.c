@@ -0,0 +1,384 @@
+/******************************************************************************
+ *
+ * Module: SIM
+ *
+ * File Name: sim_io.c
+ *
+ * Description: Simulated I/O space, time base, events and interrupts
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "sim.h"
+#include "../imp_files/io_access.h"
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SIM_MAX_EVENTS       32
+#define SIM_NO_ACCESS        0xFFFF
+
+// Pending flags of the interrupt sources, looked up by SIM_pendingVector
+typedef enum {
+    SIM_IRQ_TIMER_FLAG, SIM_IRQ_UART_RXC, SIM_IRQ_UART_UDRE, SIM_IRQ_UART_TXC
+} SIM_IrqKindType;
+
+typedef struct {
+    SIM_IrqKindType kind;
+    uint8 flag;        // TIFR flag bit for the timer sources
+    uint8 enable_bit;  // Enable bit in TIMSK (timers) or UCSRB (USART)
+    void (*vector)(void);
+} SIM_IrqType;
+
+typedef struct {
+    uint64 cycle;
+    SIM_EventHandlerType handler;
+    uint32 arg;
+} SIM_EventType;
+
+uint8 g_simIo[SIM_IO_SIZE];
+
+static uint64 g_cycle = 0;
+static uint16 g_lastAccess = SIM_NO_ACCESS;
+static uint32 g_interrupts = 0;
+static boolean g_stopped = FALSE;
+
+static SIM_EventType g_events[SIM_MAX_EVENTS];
+static uint8 g_numOfEvents = 0;
+
+static double g_realTimeFactor = 0; // 0: run as fast as possible
+static struct timespec g_wallStart;
+
+// Interrupt sources used by the HMI, in the ATmega32 vector priority order
+static const SIM_IrqType g_irqs[] = {
+    { SIM_IRQ_TIMER_FLAG, 7, 7, TIMER2_COMP_vect },
+    { SIM_IRQ_TIMER_FLAG, 6, 6, TIMER2_OVF_vect },
+    { SIM_IRQ_TIMER_FLAG, 4, 4, TIMER1_COMPA_vect },
+    { SIM_IRQ_TIMER_FLAG, 3, 3, TIMER1_COMPB_vect },
+    { SIM_IRQ_TIMER_FLAG, 2, 2, TIMER1_OVF_vect },
+    { SIM_IRQ_TIMER_FLAG, 1, 1, TIMER0_COMP_vect },
+    { SIM_IRQ_TIMER_FLAG, 0, 0, TIMER0_OVF_vect },
+    { SIM_IRQ_UART_RXC, 0, 7, USART_RXC_vect },
+    { SIM_IRQ_UART_UDRE, 0, 5, USART_UDRE_vect },
+    { SIM_IRQ_UART_TXC, 0, 6, USART_TXC_vect },
+};
+
+#define SIM_NUM_OF_IRQS (sizeof(g_irqs) / sizeof(g_irqs[0]))
+
+/*
+ * Vectors without an ISR in the firmware. Like the avr-libc default, a source
+ * enabled without a handler is a bug, so report it instead of looping on it.
+ */
+static void SIM_badInterrupt(const char *vector) {
+    fprintf(stderr, "sim: %s enabled without an ISR\n", vector);
+    SIM_stop(EXIT_FAILURE);
+}
+
+#define SIM_DEFAULT_VECTOR(vector) \
+    __attribute__((weak)) void vector(void) { SIM_badInterrupt(#vector); }
+
+SIM_DEFAULT_VECTOR(INT0_vect)
+SIM_DEFAULT_VECTOR(INT1_vect)
+SIM_DEFAULT_VECTOR(INT2_vect)
+SIM_DEFAULT_VECTOR(TIMER2_COMP_vect)
+SIM_DEFAULT_VECTOR(TIMER2_OVF_vect)
+SIM_DEFAULT_VECTOR(TIMER1_CAPT_vect)
+SIM_DEFAULT_VECTOR(TIMER1_COMPA_vect)
+SIM_DEFAULT_VECTOR(TIMER1_COMPB_vect)
+SIM_DEFAULT_VECTOR(TIMER1_OVF_vect)
+SIM_DEFAULT_VECTOR(TIMER0_COMP_vect)
+SIM_DEFAULT_VECTOR(TIMER0_OVF_vect)
+SIM_DEFAULT_VECTOR(SPI_STC_vect)
+SIM_DEFAULT_VECTOR(USART_RXC_vect)
+SIM_DEFAULT_VECTOR(USART_UDRE_vect)
+SIM_DEFAULT_VECTOR(USART_TXC_vect)
+SIM_DEFAULT_VECTOR(ADC_vect)
+SIM_DEFAULT_VECTOR(EE_RDY_vect)
+SIM_DEFAULT_VECTOR(ANA_COMP_vect)
+SIM_DEFAULT_VECTOR(TWI_vect)
+SIM_DEFAULT_VECTOR(SPM_RDY_vect)
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+// Let the peripherals see the effect of the previous register access (a write lands after SIM_ioAccess returns)
+static void SIM_sync(void) {
+    uint16 address = g_lastAccess;
+
+    g_lastAccess = SIM_NO_ACCESS;
+    if (address == SIM_NO_ACCESS) {
+        return;
+    }
+    if ((address >= SIM_PIN(3)) && (address <= SIM_PORT(0))) {
+        SIM_lcdSync(); // GPIO write: LCD bus lines may have changed
+        SIM_uartPinSync(); // and so may RTS
+        SIM_keypadSync(); // and the keypad rows
+    } else {
+        SIM_uartSync(address);
+        SIM_timerSync(address);
+    }
+}
+
+// Returns the highest priority interrupt that is pending and enabled, or NULL_PTR
+static const SIM_IrqType *SIM_pendingVector(void) {
+    uint8 i;
+    const SIM_IrqType *irq;
+
+    for (i = 0; i < SIM_NUM_OF_IRQS; i++) {
+        irq = &g_irqs[i];
+        switch (irq->kind) {
+        case SIM_IRQ_TIMER_FLAG:
+            if (((g_simIo[SIM_TIMSK] >> irq->enable_bit) & 1) && SIM_timerPending(irq->flag)) {
+                return irq;
+            }
+            break;
+        case SIM_IRQ_UART_RXC:
+            if (((g_simIo[SIM_UCSRB] >> irq->enable_bit) & 1) && SIM_uartRxPending()) {
+                return irq;
+            }
+            break;
+        case SIM_IRQ_UART_UDRE:
+            if (((g_simIo[SIM_UCSRB] >> irq->enable_bit) & 1) && SIM_uartUdrePending()) {
+                return irq;
+            }
+            break;
+        case SIM_IRQ_UART_TXC:
+            if (((g_simIo[SIM_UCSRB] >> irq->enable_bit) & 1) && SIM_uartTxPending()) {
+                return irq;
+            }
+            break;
+        }
+    }
+    return NULL_PTR;
+}
+
+// Run the pending interrupts while the I-bit is set, like the CPU between two instructions
+static void SIM_dispatchInterrupts(void) {
+    const SIM_IrqType *irq;
+
+    while ((g_simIo[SIM_SREG] >> SIM_SREG_I_bitNum) & 1) {
+        irq = SIM_pendingVector();
+        if (irq == NULL_PTR) {
+            return;
+        }
+        if (irq->kind == SIM_IRQ_TIMER_FLAG) {
+            SIM_timerAcknowledge(irq->flag); // Timer flags clear when the vector is taken
+        } else if (irq->kind == SIM_IRQ_UART_TXC) {
+            SIM_uartTxAcknowledge();
+        }
+        g_interrupts++;
+        g_simIo[SIM_SREG] &= (uint8)~(1 << SIM_SREG_I_bitNum);
+        irq->vector();
+        SIM_sync(); // e.g. the UDR read of the RXC handler
+        g_simIo[SIM_SREG] |= (1 << SIM_SREG_I_bitNum); // RETI
+    }
+}
+
+// Returns the cycle of the next scheduled event or timer flag
+static uint64 SIM_nextCycle(void) {
+    uint64 next = SIM_timerNextCycle();
+    uint8 i;
+
+    for (i = 0; i < g_numOfEvents; i++) {
+        if (g_events[i].cycle < next) {
+            next = g_events[i].cycle;
+        }
+    }
+    return next;
+}
+
+// Run the events that are due, in time order
+static void SIM_runEvents(void) {
+    uint8 i;
+    uint8 due;
+    SIM_EventType event;
+
+    for (;;) {
+        due = g_numOfEvents;
+        for (i = 0; i < g_numOfEvents; i++) {
+            if ((g_events[i].cycle <= g_cycle)
+                    && ((due == g_numOfEvents) || (g_events[i].cycle < g_events[due].cycle))) {
+                due = i;
+            }
+        }
+        if (due == g_numOfEvents) {
+            return;
+        }
+        event = g_events[due];
+        g_events[due] = g_events[--g_numOfEvents];
+        event.handler(event.arg);
+    }
+}
+
+// Hold the simulated time back to g_realTimeFactor times the wall clock time
+static void SIM_pace(void) {
+    struct timespec now;
+    double ahead;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ahead = ((double)g_cycle / F_CPU) / g_realTimeFactor
+            - ((now.tv_sec - g_wallStart.tv_sec) + (now.tv_nsec - g_wallStart.tv_nsec) / 1e9);
+    if (ahead > 0.001) {
+        now.tv_sec = (time_t)ahead;
+        now.tv_nsec = (long)((ahead - now.tv_sec) * 1e9);
+        nanosleep(&now, NULL);
+    }
+}
+
+// Move the simulated time forward, running the events and interrupts that fall on the way
+static void SIM_advanceTo(uint64 target) {
+    uint64 next;
+
+    do {
+        next = SIM_nextCycle();
+        if (next > target) {
+            next = target;
+        }
+        if (next > g_cycle) {
+            SIM_timerAdvance(next);
+            if ((g_realTimeFactor > 0) && ((next - g_cycle) > 1000)) {
+                g_cycle = next;
+                SIM_pace();
+            }
+            g_cycle = next;
+        }
+        SIM_runEvents();
+        SIM_dispatchInterrupts();
+    } while (g_cycle < target);
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+// Called by the register macros (IO_ADDRESS) for each access of the firmware
+volatile uint8 *SIM_ioAccess(uint16 address) {
+    if (!g_stopped) {
+        SIM_sync();
+        SIM_advanceTo(g_cycle + SIM_ACCESS_CYCLES);
+
+        // Bring the registers that the peripherals drive up to date
+        if ((address == SIM_PIN(0)) || (address == SIM_PIN(1)) || (address == SIM_PIN(2))
+                || (address == SIM_PIN(3))) {
+            uint8 port = (uint8)((SIM_PIN(0) - address) / 3);
+            uint8 level = 0xFF; // Inputs are pulled up
+            uint8 ddr = g_simIo[SIM_DDR(port)];
+
+            SIM_keypadDrive(port, &level);
+            SIM_lcdDrive(port, &level);
+            SIM_uartDrive(port, &level);
+            g_simIo[address] = (uint8)((g_simIo[SIM_PORT(port)] & ddr) | (level & ~ddr));
+        } else {
+            SIM_timerRefresh(address);
+        }
+        g_lastAccess = address;
+    }
+    return SIM_uartRefresh(address);
+}
+
+void SIM_sei(void) {
+    g_simIo[SIM_SREG] |= (1 << SIM_SREG_I_bitNum); // Taken at the next register access, as after SEI
+}
+
+void SIM_cli(void) {
+    g_simIo[SIM_SREG] &= (uint8)~(1 << SIM_SREG_I_bitNum);
+}
+
+void SIM_delayUs(double us) {
+    if (!g_stopped) {
+        SIM_sync();
+        SIM_advanceTo(g_cycle + SIM_US_TO_CYCLES(us));
+    }
+}
+
+void SIM_sleep(void) {
+    uint32 interrupts = g_interrupts;
+    uint64 next;
+
+    if (g_stopped) {
+        return;
+    }
+    SIM_sync();
+    if (((g_simIo[SIM_SREG] >> SIM_SREG_I_bitNum) & 1) == 0) {
+        fprintf(stderr, "sim: sleep with interrupts disabled never wakes up\n");
+        SIM_stop(EXIT_FAILURE);
+    }
+    SIM_advanceTo(g_cycle); // An interrupt that is already pending wakes the CPU at once
+    while (interrupts == g_interrupts) {
+        next = SIM_nextCycle();
+        if (next == SIM_NEVER) {
+            fprintf(stderr, "sim: sleep without a wake-up source\n");
+            SIM_stop(EXIT_FAILURE);
+        }
+        SIM_advanceTo(next);
+    }
+}
+
+uint64 SIM_now(void) {
+    return g_cycle;
+}
+
+void SIM_schedule(uint64 cycle, SIM_EventHandlerType handler, uint32 arg) {
+    if (g_numOfEvents == SIM_MAX_EVENTS) {
+        fprintf(stderr, "sim: too many events\n");
+        SIM_stop(EXIT_FAILURE);
+    }
+    g_events[g_numOfEvents].cycle = cycle;
+    g_events[g_numOfEvents].handler = handler;
+    g_events[g_numOfEvents].arg = arg;
+    g_numOfEvents++;
+}
+
+void SIM_cancel(SIM_EventHandlerType handler) {
+    uint8 i = 0;
+
+    while (i < g_numOfEvents) {
+        if (g_events[i].handler == handler) {
+            g_events[i] = g_events[--g_numOfEvents];
+        } else {
+            i++;
+        }
+    }
+}
+
+void SIM_setRealTimeFactor(double factor) {
+    g_realTimeFactor = factor;
+    clock_gettime(CLOCK_MONOTONIC, &g_wallStart);
+}
+
+void SIM_stop(int status) {
+    g_stopped = TRUE; // Firmware code called from the exit handlers must not move the time
+    exit(status);
+}
+
+boolean SIM_isStopped(void) {
+    return g_stopped;
+}
+
+uint32 SIM_interruptCount(void) {
+    return g_interrupts;
+}
+
+/* avr-libc itoa, used by LCD_intgerToString */
+char *itoa(int value, char *string, int radix) {
+    char digits[sizeof(int) * 8 + 1];
+    unsigned int magnitude = (value < 0 && radix == 10) ? -(unsigned int)value : (unsigned int)value;
+    int length = 0;
+    char *out = string;
+
+    do {
+        digits[length++] = "0123456789abcdefghijklmnopqrstuvwxyz"[magnitude % radix];
+        magnitude /= radix;
+    } while (magnitude);
+    if (value < 0 && radix == 10) {
+        *out++ = '-';
+    }
+    while (length) {
+        *out++ = digits[--length];
+    }
+    *out = '\0';
+    return string;
+}
@@ -0,0 +1,111 @@
+/******************************************************************************
+ *
+ * Module: SIM
+ *
+ * File Name: sim_keypad.c
+ *
+ * Description: Simulated keypad matrix, keys pressed by the script
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "sim.h"
+#include "../MCAL_Drivers/GPIO.h"
+#include "../HAL_Drivers/keypad.h"
+
+#define SIM_KEYPAD_NO_KEY 0xFF
+
+/*
+ * A column the pressed key pulled to its row comes back through the pull-up
+ * this long after the row is released: a read before then still sees the key,
+ * on whatever row is driven at the time.
+ */
+#define SIM_KEYPAD_RISE_US 2
+
+/* Value of each button, row by row: the map keypad.c reads from flash */
+static const uint8 g_keyMap[KEYPAD_NUM_OF_KEYS] = KEYPAD_KEY_MAP;
+
+static uint8 g_pressed = SIM_KEYPAD_NO_KEY;
+static uint8 g_pulledColumn = SIM_KEYPAD_NO_KEY; // Column pin the pressed key pulls or last pulled
+static boolean g_pulling = FALSE;                // The pressed key connects its column to a driven row
+static uint64 g_settledCycle = 0;                // When the last pulled column is back to its idle level
+static uint32 g_earlyReads = 0;
+
+// The pressed key connects its column to its row while the scan drives that row
+static boolean SIM_keypadPulling(void) {
+    uint8 row_pin;
+
+    if (g_pressed == SIM_KEYPAD_NO_KEY) {
+        return FALSE;
+    }
+    row_pin = KEYPAD_FIRST_ROW_PIN_ID + g_pressed / KEYPAD_NUM_COLS;
+    return ((g_simIo[SIM_DDR(KEYPAD_ROW_PORT_ID)] >> row_pin) & 1)
+            && (((g_simIo[SIM_PORT(KEYPAD_ROW_PORT_ID)] >> row_pin) & 1) == KEYPAD_BUTTON_PRESSED);
+}
+
+/*
+ * The script names a button by its legend: '0'..'9' for the digits (their
+ * value is the number), 'E' for Enter (13) and the character for the others.
+ */
+boolean SIM_keypadPress(char key) {
+    uint8 value = (uint8)key;
+    uint8 i;
+
+    if ((key >= '0') && (key <= '9')) {
+        value = (uint8)(key - '0');
+    } else if (key == 'E') {
+        value = 13;
+    }
+    for (i = 0; i < KEYPAD_NUM_OF_KEYS; i++) {
+        if (g_keyMap[i] == value) {
+            g_pressed = i;
+            SIM_keypadSync();
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void SIM_keypadRelease(void) {
+    g_pressed = SIM_KEYPAD_NO_KEY;
+    SIM_keypadSync();
+}
+
+// A row or a key changed: a column that stops being pulled starts to rise back
+void SIM_keypadSync(void) {
+    boolean pulling = SIM_keypadPulling();
+
+    if (pulling) {
+        g_pulledColumn = KEYPAD_FIRST_COL_PIN_ID + g_pressed % KEYPAD_NUM_COLS;
+    } else if (g_pulling) {
+        g_settledCycle = SIM_now() + SIM_US_TO_CYCLES(SIM_KEYPAD_RISE_US);
+    }
+    g_pulling = pulling;
+}
+
+// Column reads that still saw a column pulled by a row released before
+uint32 SIM_keypadEarlyReads(void) {
+    return g_earlyReads;
+}
+
+void SIM_keypadDrive(uint8 port, uint8 *level) {
+    if (port != KEYPAD_COL_PORT_ID) {
+        return;
+    }
+    if (KEYPAD_BUTTON_RELEASED == LOGIC_LOW) {
+        // Pull-down resistors on the columns
+        *level &= (uint8)~(((1 << KEYPAD_NUM_COLS) - 1) << KEYPAD_FIRST_COL_PIN_ID);
+    }
+    if (!g_pulling) {
+        if (SIM_now() >= g_settledCycle) {
+            return;
+        }
+        g_earlyReads++;
+    }
+    if (KEYPAD_BUTTON_PRESSED == LOGIC_LOW) {
+        *level &= (uint8)~(1 << g_pulledColumn);
+    } else {
+        *level |= (uint8)(1 << g_pulledColumn);
+    }
+}
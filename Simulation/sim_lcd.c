@@ -0,0 +1,275 @@
+/******************************************************************************
+ *
+ * Module: SIM
+ *
+ * File Name: sim_lcd.c
+ *
+ * Description: Simulated HD44780 character LCD, rendered to the terminal
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "sim.h"
+#include "../MCAL_Drivers/GPIO.h"
+#include "../HAL_Drivers/LCD.h"
+#include <stdio.h>
+#include <string.h>
+
+// Execution times of the controller (fosc = 270KHz)
+#define SIM_LCD_EXECUTION_US   37
+#define SIM_LCD_WRITE_US       41
+#define SIM_LCD_CLEAR_HOME_US  1520
+
+// First two function sets of the initialization by instruction
+#define SIM_LCD_INIT1_US       4100
+#define SIM_LCD_INIT2_US       100
+
+// The glass is printed once the screen has been left unchanged this long
+#define SIM_LCD_SETTLE_MS      20
+
+#define SIM_LCD_DDRAM_SIZE     0x80
+
+static uint8 g_ddram[SIM_LCD_DDRAM_SIZE];
+static uint8 g_address = 0;       // Address counter
+static boolean g_increment = TRUE;
+static boolean g_displayOn = FALSE;
+static boolean g_twoLines = FALSE;
+static boolean g_fourBits = FALSE; // The controller starts with the 8-bit interface
+static boolean g_cgram = FALSE;    // Data writes go to CGRAM (not displayed)
+static boolean g_highNibble = FALSE;
+static uint8 g_nibble;
+static boolean g_enable = FALSE;
+static uint64 g_busyUntil = 0;
+
+#if (LCD_DATA_BITS_MODE == 4)
+// DB0..DB3 are not wired: the controller only gets to the 4-bit interface by
+// the initialization by instruction, whose first two steps take longer
+static uint8 g_initSteps = 0;
+#endif
+
+static uint32 g_instructions = 0;
+static uint32 g_violations = 0;
+
+void (*g_simLcdObserver)(void) = NULL_PTR;
+
+static boolean g_render = TRUE;
+static boolean g_renderScheduled = FALSE;
+static char g_shown[LCD_NUM_ROWS][LCD_NUM_COLS + 1];
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+// Level of an MCU pin driven as output (an input pin is seen as low)
+static uint8 SIM_lcdPin(uint8 port, uint8 pin) {
+    return ((g_simIo[SIM_DDR(port)] & g_simIo[SIM_PORT(port)]) >> pin) & 1;
+}
+
+static uint8 SIM_lcdReadWrite(void) {
+#if (LCD_USE_BUSY_FLAG == 1)
+    return (g_simIo[SIM_DDR(LCD_RW_PORT_ID)] >> LCD_RW_PIN_ID) & (g_simIo[SIM_PORT(LCD_RW_PORT_ID)] >> LCD_RW_PIN_ID) & 1;
+#else
+    return 0; // RW tied to GND
+#endif
+}
+
+// Cell (row, col) of the glass, rows 2 and 3 continue rows 0 and 1
+static uint8 SIM_lcdCellAddress(uint8 row, uint8 col) {
+    return (uint8)(((row & 1) ? 0x40 : 0) + ((row & 2) ? LCD_NUM_COLS : 0) + col);
+}
+
+static void SIM_lcdRenderEvent(uint32 arg) {
+    g_renderScheduled = FALSE;
+    SIM_lcdRender();
+}
+
+static void SIM_lcdChanged(void) {
+    if (g_simLcdObserver != NULL_PTR) {
+        g_simLcdObserver();
+    }
+    if (g_render && !g_renderScheduled) {
+        g_renderScheduled = TRUE;
+        SIM_schedule(SIM_now() + SIM_MS_TO_CYCLES(SIM_LCD_SETTLE_MS), SIM_lcdRenderEvent, 0);
+    }
+}
+
+static void SIM_lcdMoveAddress(void) {
+    g_address = (uint8)((g_address + (g_increment ? 1 : -1)) & (SIM_LCD_DDRAM_SIZE - 1));
+    if (g_twoLines) {
+        // Each line holds 40 characters: 0x00-0x27 and 0x40-0x67
+        if (g_address == 0x28) {
+            g_address = 0x40;
+        } else if (g_address == 0x68) {
+            g_address = 0x00;
+        } else if (g_address == 0x7F) {
+            g_address = 0x67;
+        } else if (g_address == 0x3F) {
+            g_address = 0x27;
+        }
+    }
+}
+
+static void SIM_lcdExecute(uint8 rs, uint8 value) {
+    uint32 time_us = SIM_LCD_EXECUTION_US;
+
+    g_instructions++;
+    if (SIM_now() < g_busyUntil) {
+        g_violations++; // Sent before the previous instruction was finished
+    }
+
+    if (rs) {
+        time_us = SIM_LCD_WRITE_US;
+        if (!g_cgram) {
+            g_ddram[g_address] = value;
+            SIM_lcdChanged();
+        }
+        SIM_lcdMoveAddress();
+    } else if (value & 0x80) {
+        g_address = value & 0x7F; // Set DDRAM address
+        g_cgram = FALSE;
+    } else if (value & 0x40) {
+        g_cgram = TRUE; // Set CGRAM address
+    } else if (value & 0x20) {
+#if (LCD_DATA_BITS_MODE == 4)
+        if (!g_fourBits && (g_initSteps < 2)) {
+            time_us = g_initSteps++ ? SIM_LCD_INIT2_US : SIM_LCD_INIT1_US;
+        }
+#endif
+        g_fourBits = (value & 0x10) == 0; // Function set
+        g_twoLines = (value & 0x08) != 0;
+    } else if (value & 0x10) {
+        if ((value & 0x08) == 0) {
+            boolean increment = g_increment; // Cursor shift (display shift is not simulated)
+
+            g_increment = (value & 0x04) != 0;
+            SIM_lcdMoveAddress();
+            g_increment = increment;
+        }
+    } else if (value & 0x08) {
+        g_displayOn = (value & 0x04) != 0; // Display on/off control
+        SIM_lcdChanged();
+    } else if (value & 0x04) {
+        g_increment = (value & 0x02) != 0; // Entry mode set
+    } else if (value & 0x02) {
+        g_address = 0; // Return home
+        g_cgram = FALSE;
+        time_us = SIM_LCD_CLEAR_HOME_US;
+    } else if (value & 0x01) {
+        memset(g_ddram, ' ', sizeof(g_ddram)); // Clear display
+        g_address = 0;
+        g_increment = TRUE;
+        g_cgram = FALSE;
+        time_us = SIM_LCD_CLEAR_HOME_US;
+        SIM_lcdChanged();
+    }
+    g_busyUntil = SIM_now() + SIM_US_TO_CYCLES(time_us);
+}
+
+// What the glass shows, one string per row
+static void SIM_lcdGlass(char glass[LCD_NUM_ROWS][LCD_NUM_COLS + 1]) {
+    uint8 row, col, c;
+
+    for (row = 0; row < LCD_NUM_ROWS; row++) {
+        for (col = 0; col < LCD_NUM_COLS; col++) {
+            c = g_ddram[SIM_lcdCellAddress(row, col)];
+            glass[row][col] = (char)((g_displayOn && (c >= 0x20) && (c < 0x7F)) ? c : ' ');
+        }
+        glass[row][LCD_NUM_COLS] = '\0';
+    }
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+void SIM_lcdInit(boolean render) {
+    memset(g_ddram, ' ', sizeof(g_ddram));
+    memset(g_shown, 0, sizeof(g_shown));
+    g_render = render;
+}
+
+// Latch the bus on the falling edge of E
+void SIM_lcdSync(void) {
+    boolean enable = SIM_lcdPin(LCD_E_PORT_ID, LCD_E_PIN_ID);
+    uint8 bus;
+
+    if (g_enable && !enable) {
+        if (SIM_lcdReadWrite()) {
+            g_highNibble = g_fourBits && !g_highNibble; // Busy flag read
+        } else {
+#if (LCD_DATA_BITS_MODE == 4)
+            bus = (uint8)((SIM_lcdPin(LCD_DATA_PORT_ID, LCD_DB4_PIN_ID) << 4)
+                    | (SIM_lcdPin(LCD_DATA_PORT_ID, LCD_DB5_PIN_ID) << 5)
+                    | (SIM_lcdPin(LCD_DATA_PORT_ID, LCD_DB6_PIN_ID) << 6)
+                    | (SIM_lcdPin(LCD_DATA_PORT_ID, LCD_DB7_PIN_ID) << 7));
+#else
+            bus = (uint8)(g_simIo[SIM_PORT(LCD_DATA_PORT_ID)] & g_simIo[SIM_DDR(LCD_DATA_PORT_ID)]);
+#endif
+            if (!g_fourBits) {
+                SIM_lcdExecute(SIM_lcdPin(LCD_RS_PORT_ID, LCD_RS_PIN_ID), bus);
+            } else if (!g_highNibble) {
+                g_nibble = bus & 0xF0;
+                g_highNibble = TRUE;
+            } else {
+                g_highNibble = FALSE;
+                SIM_lcdExecute(SIM_lcdPin(LCD_RS_PORT_ID, LCD_RS_PIN_ID),
+                        (uint8)(g_nibble | (bus >> 4)));
+            }
+        }
+    }
+    g_enable = enable;
+}
+
+// Busy flag on DB7 while E is high in a read cycle
+void SIM_lcdDrive(uint8 port, uint8 *level) {
+    if ((port == LCD_DATA_PORT_ID) && g_enable && SIM_lcdReadWrite() && !g_highNibble) {
+        if (SIM_now() < g_busyUntil) {
+            *level |= (uint8)(1 << LCD_DB7_PIN_ID);
+        } else {
+            *level &= (uint8)~(1 << LCD_DB7_PIN_ID);
+        }
+    }
+}
+
+// Print the glass if it changed since the last time
+void SIM_lcdRender(void) {
+    char glass[LCD_NUM_ROWS][LCD_NUM_COLS + 1];
+    uint8 row;
+
+    SIM_lcdGlass(glass);
+    if (memcmp(glass, g_shown, sizeof(glass)) == 0) {
+        return;
+    }
+    memcpy(g_shown, glass, sizeof(glass));
+
+    printf("[%10.3f ms] LCD\n", SIM_CYCLES_TO_MS(SIM_now()));
+    printf("    +%.*s+\n", LCD_NUM_COLS, "----------------------------------------");
+    for (row = 0; row < LCD_NUM_ROWS; row++) {
+        printf("    |%s|\n", glass[row]);
+    }
+    printf("    +%.*s+\n", LCD_NUM_COLS, "----------------------------------------");
+    fflush(stdout);
+}
+
+// TRUE if one of the rows shows the text
+boolean SIM_lcdShows(const char *text) {
+    char glass[LCD_NUM_ROWS][LCD_NUM_COLS + 1];
+    uint8 row;
+
+    SIM_lcdGlass(glass);
+    for (row = 0; row < LCD_NUM_ROWS; row++) {
+        if (strstr(glass[row], text)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+uint32 SIM_lcdInstructions(void) {
+    return g_instructions;
+}
+
+uint32 SIM_lcdViolations(void) {
+    return g_violations;
+}
@@ -0,0 +1,429 @@
+/******************************************************************************
+ *
+ * Module: SIM
+ *
+ * File Name: sim_main.c
+ *
+ * Description: Command line, test script player and report of the host
+ *              simulation of the HMI_ECU firmware
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "sim.h"
+#include "../MCAL_Drivers/Power.h"
+#include "../MCAL_Drivers/UART.h"
+#include "../HAL_Drivers/Protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_MAX_COMMANDS       256
+#define SIM_MAX_TEXT           64
+#define SIM_SCRIPT_SETTLE_MS   2000  // Run time after the end of the script
+#define SIM_TRACE_GAP_MS       2     // Idle time that ends a line of UART trace
+
+typedef enum {
+    SIM_CMD_WAIT, SIM_CMD_KEY, SIM_CMD_HOLD, SIM_CMD_GAP, SIM_CMD_RX, SIM_CMD_ADDRESS,
+    SIM_CMD_EXPECT, SIM_CMD_QUIT
+} SIM_CommandKindType;
+
+typedef struct {
+    SIM_CommandKindType kind;
+    uint32 value;
+    uint8 length;
+    uint8 text[SIM_MAX_TEXT];
+    uint64 latency;     // expect: cycles from the last key press to the text (SIM_NEVER: not seen)
+} SIM_CommandType;
+
+/* Firmware entry point, main.c is built with -Dmain=HMI_main */
+int HMI_main(void);
+
+/* Worst-case event handling time measured by main.c */
+extern uint32 dispatch_max_us;
+
+static SIM_CommandType g_script[SIM_MAX_COMMANDS];
+static uint16 g_numOfCommands = 0;
+static uint16 g_pc = 0;
+static uint8 g_keyIndex = 0;
+static boolean g_keyDown = FALSE;
+static uint32 g_holdMs = 40;
+static uint32 g_gapMs = 60;
+static boolean g_timeLimit = FALSE;
+static uint64 g_keyCycle = 0;        // Last key press
+static uint64 g_seenCycle = SIM_NEVER; // The next expected text showed up
+static boolean g_expecting = FALSE;  // The script waits for the text
+
+static boolean g_quiet = FALSE;
+static uint8 g_trace[64];
+static uint8 g_traceLength = 0;
+static boolean g_traceTransmit;
+static uint64 g_traceStart;
+
+static struct timespec g_hostStart;
+
+/*******************************************************************************
+ *                      Test Script                                            *
+ *******************************************************************************/
+
+static void SIM_stopEvent(uint32 arg) {
+    SIM_stop(EXIT_SUCCESS);
+}
+
+static void SIM_scriptStep(uint32 arg);
+static void SIM_expectTimeout(uint32 arg);
+
+// The next expect command of the script, if any
+static SIM_CommandType *SIM_scriptNextExpect(void) {
+    uint16 pc;
+
+    for (pc = g_pc; pc < g_numOfCommands; pc++) {
+        if (g_script[pc].kind == SIM_CMD_EXPECT) {
+            return &g_script[pc];
+        }
+    }
+    return NULL_PTR;
+}
+
+// Time the text of the next expect command shows up, even before the script gets there
+static void SIM_scriptLcdChanged(void) {
+    SIM_CommandType *command = SIM_scriptNextExpect();
+
+    if ((command == NULL_PTR) || (g_seenCycle != SIM_NEVER)
+            || !SIM_lcdShows((const char *)command->text)) {
+        return;
+    }
+    g_seenCycle = SIM_now();
+    if (g_expecting) {
+        g_expecting = FALSE;
+        SIM_cancel(SIM_expectTimeout);
+        SIM_schedule(SIM_now(), SIM_scriptStep, 0);
+    }
+}
+
+static void SIM_expectTimeout(uint32 arg) {
+    fprintf(stderr, "sim: \"%s\" not shown after %lu ms\n", (const char *)g_script[g_pc].text,
+            (unsigned long)g_script[g_pc].value);
+    SIM_stop(EXIT_FAILURE);
+}
+
+static void SIM_scriptStep(uint32 arg) {
+    SIM_CommandType *command;
+
+    while (g_pc < g_numOfCommands) {
+        command = &g_script[g_pc];
+        switch (command->kind) {
+        case SIM_CMD_WAIT:
+            g_pc++;
+            SIM_schedule(SIM_now() + SIM_MS_TO_CYCLES(command->value), SIM_scriptStep, 0);
+            return;
+        case SIM_CMD_KEY:
+            if (g_keyDown) {
+                SIM_keypadRelease();
+                g_keyDown = FALSE;
+                g_keyIndex++;
+                SIM_schedule(SIM_now() + SIM_MS_TO_CYCLES(g_gapMs), SIM_scriptStep, 0);
+                return;
+            }
+            if (g_keyIndex < command->length) {
+                SIM_keypadPress((char)command->text[g_keyIndex]);
+                g_keyDown = TRUE;
+                g_keyCycle = SIM_now();
+                g_seenCycle = SIM_NEVER;
+                SIM_schedule(SIM_now() + SIM_MS_TO_CYCLES(g_holdMs), SIM_scriptStep, 0);
+                return;
+            }
+            g_keyIndex = 0;
+            g_pc++;
+            break;
+        case SIM_CMD_HOLD:
+            g_holdMs = command->value;
+            g_pc++;
+            break;
+        case SIM_CMD_GAP:
+            g_gapMs = command->value;
+            g_pc++;
+            break;
+        case SIM_CMD_RX:
+            SIM_uartPeerSend(command->text, command->length, 0);
+            g_pc++;
+            break;
+        case SIM_CMD_ADDRESS:
+            SIM_uartPeerSendAddress((uint8)command->value, 0);
+            g_pc++;
+            break;
+        case SIM_CMD_EXPECT:
+            if ((g_seenCycle == SIM_NEVER) && SIM_lcdShows((const char *)command->text)) {
+                g_seenCycle = g_keyCycle; // Was already there before the last key
+            }
+            if (g_seenCycle == SIM_NEVER) {
+                g_expecting = TRUE;
+                SIM_schedule(SIM_now() + SIM_MS_TO_CYCLES(command->value), SIM_expectTimeout, 0);
+                return;
+            }
+            command->latency = (g_seenCycle > g_keyCycle) ? (g_seenCycle - g_keyCycle) : 0;
+            g_seenCycle = SIM_NEVER;
+            if (!g_quiet) {
+                printf("[%10.3f ms] \"%s\" shown %.3f ms after the last key\n",
+                        SIM_CYCLES_TO_MS(SIM_now()), (const char *)command->text,
+                        SIM_CYCLES_TO_MS(command->latency));
+            }
+            g_pc++;
+            break;
+        case SIM_CMD_QUIT:
+            SIM_stop(EXIT_SUCCESS);
+            break;
+        }
+    }
+    if (!g_timeLimit) {
+        SIM_schedule(SIM_now() + SIM_MS_TO_CYCLES(SIM_SCRIPT_SETTLE_MS), SIM_stopEvent, 0);
+    }
+}
+
+static void SIM_scriptError(const char *file, int line, const char *message) {
+    fprintf(stderr, "%s:%d: %s\n", file, line, message);
+    exit(EXIT_FAILURE);
+}
+
+static SIM_CommandType *SIM_scriptAdd(SIM_CommandKindType kind) {
+    if (g_numOfCommands == SIM_MAX_COMMANDS) {
+        fprintf(stderr, "sim: script too long\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(&g_script[g_numOfCommands], 0, sizeof(SIM_CommandType));
+    g_script[g_numOfCommands].kind = kind;
+    g_script[g_numOfCommands].latency = SIM_NEVER;
+    return &g_script[g_numOfCommands++];
+}
+
+static void SIM_scriptAddKeys(const char *keys, const char *file, int line) {
+    SIM_CommandType *command = SIM_scriptAdd(SIM_CMD_KEY);
+
+    while (*keys && (command->length < SIM_MAX_TEXT)) {
+        if (!SIM_keypadPress(*keys)) {
+            SIM_scriptError(file, line, "unknown key");
+        }
+        command->text[command->length++] = (uint8)*keys++;
+    }
+    SIM_keypadRelease();
+}
+
+/*
+ * One command per line, '#' starts a comment:
+ *   wait <ms>          let the firmware run
+ *   key <keys>         press and release each key in turn
+ *   hold <ms>          how long key presses last (40 ms)
+ *   gap <ms>           time between two key presses (60 ms)
+ *   rx <hex bytes>     bytes sent to the HMI by the Control ECU
+ *   address <hex>      address frame (ninth bit set) sent by the Control ECU
+ *   expect "<text>" <ms>
+ *                      wait until the LCD shows the text, and report how long
+ *                      after the last key press it showed up; the simulation
+ *                      fails if it is not shown within <ms>
+ *   quit               end the simulation
+ */
+static void SIM_scriptLoad(const char *file) {
+    FILE *stream = fopen(file, "r");
+    char text[256];
+    char word[16];
+    char argument[200];
+    char *token;
+    unsigned long timeout;
+    int line = 0;
+    SIM_CommandType *command;
+
+    if (stream == NULL) {
+        perror(file);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(text, sizeof(text), stream)) {
+        line++;
+        if (strchr(text, '#')) {
+            *strchr(text, '#') = '\0';
+        }
+        argument[0] = '\0';
+        if (sscanf(text, "%15s %199[^\n]", word, argument) < 1) {
+            continue;
+        }
+        if (!strcmp(word, "wait") || !strcmp(word, "hold") || !strcmp(word, "gap")) {
+            command = SIM_scriptAdd(!strcmp(word, "wait") ? SIM_CMD_WAIT
+                    : !strcmp(word, "hold") ? SIM_CMD_HOLD : SIM_CMD_GAP);
+            command->value = (uint32)strtoul(argument, NULL, 0);
+        } else if (!strcmp(word, "key")) {
+            SIM_scriptAddKeys(strtok(argument, " \t"), file, line);
+        } else if (!strcmp(word, "rx")) {
+            command = SIM_scriptAdd(SIM_CMD_RX);
+            for (token = strtok(argument, " \t"); token; token = strtok(NULL, " \t")) {
+                if (command->length == SIM_MAX_TEXT) {
+                    SIM_scriptError(file, line, "too many bytes");
+                }
+                command->text[command->length++] = (uint8)strtoul(token, NULL, 16);
+            }
+        } else if (!strcmp(word, "address")) {
+            command = SIM_scriptAdd(SIM_CMD_ADDRESS);
+            command->value = (uint32)strtoul(argument, NULL, 16);
+        } else if (!strcmp(word, "expect")) {
+            command = SIM_scriptAdd(SIM_CMD_EXPECT);
+            if (sscanf(argument, "\"%63[^\"]\" %lu", (char *)command->text, &timeout) != 2) {
+                SIM_scriptError(file, line, "expect needs a quoted text and a timeout");
+            }
+            command->value = (uint32)timeout;
+        } else if (!strcmp(word, "quit")) {
+            SIM_scriptAdd(SIM_CMD_QUIT);
+        } else {
+            SIM_scriptError(file, line, "unknown command");
+        }
+    }
+    fclose(stream);
+}
+
+/*******************************************************************************
+ *                      UART Trace                                             *
+ *******************************************************************************/
+
+static void SIM_traceFlush(uint32 arg) {
+    uint8 i;
+
+    if (g_traceLength == 0) {
+        return;
+    }
+    printf("[%10.3f ms] UART %s", SIM_CYCLES_TO_MS(g_traceStart), g_traceTransmit ? "TX" : "RX");
+    for (i = 0; i < g_traceLength; i++) {
+        printf(" %02X", g_trace[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+    g_traceLength = 0;
+}
+
+// Print the bytes on the line, one line per burst in each direction
+static void SIM_traceMonitor(boolean transmit, uint8 data) {
+    if ((g_traceLength == sizeof(g_trace)) || (g_traceLength && (transmit != g_traceTransmit))) {
+        SIM_traceFlush(0);
+    }
+    if (g_traceLength == 0) {
+        g_traceStart = SIM_now();
+        g_traceTransmit = transmit;
+    }
+    g_trace[g_traceLength++] = data;
+    SIM_cancel(SIM_traceFlush);
+    SIM_schedule(SIM_now() + SIM_MS_TO_CYCLES(SIM_TRACE_GAP_MS), SIM_traceFlush, 0);
+}
+
+/*******************************************************************************
+ *                      Report                                                 *
+ *******************************************************************************/
+
+static void SIM_report(void) {
+    struct timespec now;
+    double host_ms;
+    double sim_ms = SIM_CYCLES_TO_MS(SIM_now());
+    UART_StatsType uart;
+    Protocol_StatsType protocol;
+    uint16 pc;
+
+    if (!g_quiet) {
+        SIM_traceFlush(0);
+        SIM_lcdRender();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    host_ms = (now.tv_sec - g_hostStart.tv_sec) * 1000.0 + (now.tv_nsec - g_hostStart.tv_nsec) / 1e6;
+
+    printf("---- simulation report ----\n");
+    printf("simulated time     : %.3f ms (%.0fx real time)\n", sim_ms,
+            (host_ms > 0) ? sim_ms / host_ms : 0.0);
+    printf("CPU active / sleep : %lu ms / %lu ms\n", (unsigned long)Power_getActiveMs(),
+            (unsigned long)Power_getSleepMs());
+    printf("interrupts         : %lu\n", (unsigned long)SIM_interruptCount());
+    printf("worst event        : %lu us\n", (unsigned long)dispatch_max_us);
+    printf("LCD instructions   : %lu (%lu sent while busy)\n", (unsigned long)SIM_lcdInstructions(),
+            (unsigned long)SIM_lcdViolations());
+    printf("keypad             : %lu column reads before the line settled\n",
+            (unsigned long)SIM_keypadEarlyReads());
+    printf("UART bytes         : %lu sent, %lu received\n", (unsigned long)SIM_uartBytesSent(),
+            (unsigned long)SIM_uartBytesReceived());
+#if UART_FLOW_CONTROL
+    printf("UART RTS pauses    : %lu\n", (unsigned long)SIM_uartHolds());
+#endif
+    UART_getStats(&uart);
+    printf("UART errors        : %u overruns, %u frame errors, %u parity errors, %u RX overflows\n",
+            uart.overruns, uart.frame_errors, uart.parity_errors, uart.rx_overflows);
+    PROTOCOL_getStats(&protocol);
+    printf("frames             : %u received, %u sent, %u CRC errors, %u cut\n",
+            protocol.frames_received, protocol.frames_sent, protocol.crc_errors, protocol.cut_frames);
+    for (pc = 0; pc < g_numOfCommands; pc++) {
+        if (g_script[pc].kind != SIM_CMD_EXPECT) {
+            continue;
+        }
+        printf("%-19s: ", (const char *)g_script[pc].text);
+        if (g_script[pc].latency == SIM_NEVER) {
+            printf("not shown\n");
+        } else {
+            printf("%.3f ms after the last key\n", SIM_CYCLES_TO_MS(g_script[pc].latency));
+        }
+    }
+    fflush(stdout); // Before the reports of the exit handlers registered earlier
+}
+
+static void SIM_usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [-s script] [-k keys] [-c command] [-t ms] [-x factor] [-q]\n"
+            "  -s script  run the test script (see SIM_scriptLoad in sim_main.c)\n"
+            "  -c command run command as the Control ECU, e.g. -c \"./control_emu -r 5000\"\n"
+            "  -k keys    type the keys after 500 ms, e.g. -k 12345E12345E\n"
+            "  -t ms      stop after this simulated time (default: 2 s after the script)\n"
+            "  -x factor  run at most factor times faster than real time\n"
+            "  -q         do not print the LCD and the UART traffic\n", program);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int option;
+    SIM_CommandType *command;
+    const char *peer = NULL_PTR;
+
+    while ((option = getopt(argc, argv, "s:k:c:t:x:q")) != -1) {
+        switch (option) {
+        case 's':
+            SIM_scriptLoad(optarg);
+            break;
+        case 'k':
+            command = SIM_scriptAdd(SIM_CMD_WAIT);
+            command->value = 500;
+            SIM_scriptAddKeys(optarg, "-k", 1);
+            break;
+        case 'c':
+            peer = optarg;
+            break;
+        case 't':
+            g_timeLimit = TRUE;
+            SIM_schedule(SIM_MS_TO_CYCLES(strtod(optarg, NULL)), SIM_stopEvent, 0);
+            break;
+        case 'x':
+            SIM_setRealTimeFactor(strtod(optarg, NULL));
+            break;
+        case 'q':
+            g_quiet = TRUE;
+            break;
+        default:
+            SIM_usage(argv[0]);
+        }
+    }
+
+    SIM_lcdInit(!g_quiet);
+    g_simLcdObserver = SIM_scriptLcdChanged;
+    if (!g_quiet) {
+        g_simUartMonitor = SIM_traceMonitor;
+    }
+    if (peer != NULL_PTR) {
+        SIM_peerStart(peer);
+    }
+    SIM_schedule(0, SIM_scriptStep, 0);
+    clock_gettime(CLOCK_MONOTONIC, &g_hostStart);
+    atexit(SIM_report);
+
+    return HMI_main(); // Never returns, SIM_stop ends the simulation
+}
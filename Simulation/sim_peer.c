@@ -0,0 +1,145 @@
+/******************************************************************************
+ *
+ * Module: SIM
+ *
+ * File Name: sim_peer.c
+ *
+ * Description: Control ECU program on the other end of the simulated line
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+/*
+ * The program (control_emu or any other) runs with its stdin and stdout on a
+ * socketpair and is told about every byte the HMI sends, with the simulated
+ * time. The simulation waits for its answer before going on, so the two stay
+ * in lockstep and a run gives the same latencies every time. The messages are
+ * described in control_emu.c.
+ */
+
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static FILE *g_toPeer = NULL_PTR;
+static FILE *g_fromPeer = NULL_PTR;
+static pid_t g_pid;
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+static unsigned long long SIM_peerTimeUs(void) {
+    return SIM_now() / (F_CPU / 1000000UL);
+}
+
+static unsigned long SIM_peerNextNumber(void) {
+    char *token = strtok(NULL, " \t\n");
+
+    return token ? strtoul(token, NULL, 0) : 0;
+}
+
+static void SIM_peerWake(uint32 arg);
+
+// Send one message and carry out the answer, up to the "." line
+static void SIM_peerExchange(const char *message) {
+    char line[512];
+    uint8 bytes[255];
+    uint8 length;
+    char *token;
+    unsigned long delay_us;
+
+    fputs(message, g_toPeer);
+    fflush(g_toPeer);
+    for (;;) {
+        if (fgets(line, sizeof(line), g_fromPeer) == NULL) {
+            fprintf(stderr, "sim: the Control ECU program stopped\n");
+            SIM_stop(EXIT_FAILURE);
+        }
+        if (line[0] == '.') {
+            return;
+        }
+        token = strtok(line, " \t\n");
+        if (token == NULL) {
+            continue;
+        }
+        if (!strcmp(token, "S")) {
+            delay_us = SIM_peerNextNumber();
+            length = 0;
+            while ((token = strtok(NULL, " \t\n")) && (length < sizeof(bytes))) {
+                bytes[length++] = (uint8)strtoul(token, NULL, 16);
+            }
+            SIM_uartPeerSend(bytes, length, SIM_US_TO_CYCLES(delay_us));
+        } else if (!strcmp(token, "A")) {
+            delay_us = SIM_peerNextNumber();
+            token = strtok(NULL, " \t\n");
+            SIM_uartPeerSendAddress(token ? (uint8)strtoul(token, NULL, 16) : 0, SIM_US_TO_CYCLES(delay_us));
+        } else if (!strcmp(token, "R")) {
+            SIM_uartSetPeerBaud((uint32)SIM_peerNextNumber());
+        } else if (!strcmp(token, "W")) {
+            delay_us = SIM_peerNextNumber();
+            SIM_schedule(SIM_now() + SIM_US_TO_CYCLES(delay_us), SIM_peerWake, 0);
+        } else {
+            fprintf(stderr, "sim: unknown answer from the Control ECU program: %s\n", token);
+            SIM_stop(EXIT_FAILURE);
+        }
+    }
+}
+
+static void SIM_peerWake(uint32 arg) {
+    char message[32];
+
+    snprintf(message, sizeof(message), "T %llu\n", SIM_peerTimeUs());
+    SIM_peerExchange(message);
+}
+
+static void SIM_peerByte(uint8 data, boolean frame_error) {
+    char message[32];
+
+    snprintf(message, sizeof(message), "%c %llu %02X\n", frame_error ? 'F' : 'B', SIM_peerTimeUs(), data);
+    SIM_peerExchange(message);
+}
+
+// Close the line so the program sees its end of input, and let it report
+static void SIM_peerStop(void) {
+    fclose(g_toPeer);
+    fclose(g_fromPeer);
+    waitpid(g_pid, NULL, 0);
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+void SIM_peerStart(const char *command) {
+    int sockets[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+        perror("socketpair");
+        exit(EXIT_FAILURE);
+    }
+    fflush(stdout);
+    g_pid = fork();
+    if (g_pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (g_pid == 0) {
+        dup2(sockets[1], STDIN_FILENO);
+        dup2(sockets[1], STDOUT_FILENO);
+        close(sockets[0]);
+        close(sockets[1]);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+    close(sockets[1]);
+    g_toPeer = fdopen(sockets[0], "w");
+    g_fromPeer = fdopen(dup(sockets[0]), "r");
+    g_simUartPeer = SIM_peerByte;
+    atexit(SIM_peerStop);
+}
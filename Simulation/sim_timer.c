@@ -0,0 +1,229 @@
+/******************************************************************************
+ *
+ * Module: SIM
+ *
+ * File Name: sim_timer.c
+ *
+ * Description: Simulated Timer0, Timer1 and Timer2 (normal and CTC modes)
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "sim.h"
+
+#define SIM_NUM_OF_TIMERS 3
+
+typedef struct {
+    uint16 tcnt;        // Address of the counter register
+    uint8 compare_flag; // TIFR bit set on compare match
+    uint8 overflow_flag;// TIFR bit set on overflow
+    uint32 max;         // Counter MAX value
+} SIM_TimerInfoType;
+
+typedef struct {
+    uint64 last;        // Cycle the count was last brought up to date
+    uint32 count;
+    uint32 shown;       // Count last copied to the counter register
+} SIM_TimerType;
+
+static const SIM_TimerInfoType g_info[SIM_NUM_OF_TIMERS] = {
+    { SIM_TCNT0, 1, 0, 0xFF },
+    { SIM_TCNT1, 4, 2, 0xFFFF },
+    { SIM_TCNT2, 7, 6, 0xFF },
+};
+
+static SIM_TimerType g_timers[SIM_NUM_OF_TIMERS];
+
+// Timer interrupt flags (TIFR)
+static uint8 g_tifr = 0;
+static uint8 g_tifrShown = 0;
+
+// Clock select to prescaler, 0 for stopped (external clocks are not simulated)
+static const uint16 g_prescaler01[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+static const uint16 g_prescaler2[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+static uint32 SIM_timerPrescaler(uint8 id) {
+    switch (id) {
+    case 0:
+        return g_prescaler01[g_simIo[SIM_TCCR0] & 0x07];
+    case 1:
+        return g_prescaler01[g_simIo[SIM_TCCR1B] & 0x07];
+    default:
+        return g_prescaler2[g_simIo[SIM_TCCR2] & 0x07];
+    }
+}
+
+// Get the TOP of the count and the compare value from the mode registers
+static void SIM_timerShape(uint8 id, uint32 *top, uint32 *compare) {
+    uint8 wgm;
+
+    *top = g_info[id].max;
+    switch (id) {
+    case 0:
+    case 2: {
+        uint8 tccr = g_simIo[(id == 0) ? SIM_TCCR0 : SIM_TCCR2];
+        *compare = g_simIo[(id == 0) ? SIM_OCR0 : SIM_OCR2];
+        if ((tccr & 0x48) == 0x08) { // WGMn1:0 = 2, CTC
+            *top = *compare;
+        }
+        break;
+    }
+    default:
+        *compare = g_simIo[SIM_OCR1A] | (g_simIo[SIM_OCR1A + 1] << 8);
+        wgm = (uint8)((g_simIo[SIM_TCCR1A] & 0x03) | ((g_simIo[SIM_TCCR1B] >> 1) & 0x0C));
+        if (wgm == 4) {
+            *top = *compare; // CTC, TOP = OCR1A
+        } else if (wgm == 12) {
+            *top = g_simIo[SIM_ICR1] | (g_simIo[SIM_ICR1 + 1] << 8); // CTC, TOP = ICR1
+        }
+        break;
+    }
+}
+
+// Counter ticks until the next compare match or overflow (0 if none)
+static uint32 SIM_timerTicksToFlag(uint8 id, uint32 count, uint32 top, uint32 compare,
+        uint8 flag) {
+    if (flag == g_info[id].compare_flag) {
+        if (compare > top) {
+            return 0;
+        }
+        return (compare > count) ? (compare - count) : (top + 1 - count + compare);
+    }
+    if (top != g_info[id].max) {
+        return 0; // TOV is only set when the count wraps at MAX
+    }
+    return top + 1 - count;
+}
+
+static void SIM_timerAdvanceOne(uint8 id, uint64 cycle) {
+    SIM_TimerType *timer = &g_timers[id];
+    uint32 prescaler = SIM_timerPrescaler(id);
+    uint32 top, compare, ticks, distance;
+
+    if ((prescaler == 0) || (cycle <= timer->last)) {
+        if (prescaler == 0) {
+            timer->last = cycle; // Stopped
+        }
+        return;
+    }
+    ticks = (uint32)((cycle - timer->last) / prescaler);
+    if (ticks == 0) {
+        return;
+    }
+    timer->last += (uint64)ticks * prescaler;
+
+    SIM_timerShape(id, &top, &compare);
+    if (timer->count > top) {
+        top = g_info[id].max; // Beyond a lowered TOP the count runs up to MAX first
+    }
+    distance = SIM_timerTicksToFlag(id, timer->count, top, compare, g_info[id].compare_flag);
+    if (distance && (ticks >= distance)) {
+        g_tifr |= (uint8)(1 << g_info[id].compare_flag);
+    }
+    distance = SIM_timerTicksToFlag(id, timer->count, top, compare, g_info[id].overflow_flag);
+    if (distance && (ticks >= distance)) {
+        g_tifr |= (uint8)(1 << g_info[id].overflow_flag);
+    }
+    timer->count = (uint32)(((uint64)timer->count + ticks) % ((uint64)top + 1));
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+void SIM_timerSync(uint16 address) {
+    uint8 id;
+    uint32 value;
+
+    if (address == SIM_TIFR) {
+        if (g_simIo[SIM_TIFR] != g_tifrShown) {
+            g_tifr &= (uint8)~g_simIo[SIM_TIFR]; // Flags are cleared by writing one
+        }
+        return;
+    }
+    for (id = 0; id < SIM_NUM_OF_TIMERS; id++) {
+        if ((address == g_info[id].tcnt) || ((id == 1) && (address == SIM_TCNT1 + 1))) {
+            value = g_simIo[g_info[id].tcnt];
+            if (id == 1) {
+                value |= (uint32)g_simIo[SIM_TCNT1 + 1] << 8;
+            }
+            if (value != g_timers[id].shown) {
+                g_timers[id].count = value; // Written by the firmware
+                g_timers[id].shown = value;
+                g_timers[id].last = SIM_now();
+            }
+        }
+    }
+}
+
+void SIM_timerRefresh(uint16 address) {
+    uint8 id;
+
+    if (address == SIM_TIFR) {
+        g_simIo[SIM_TIFR] = g_tifrShown = g_tifr;
+        return;
+    }
+    for (id = 0; id < SIM_NUM_OF_TIMERS; id++) {
+        if ((address == g_info[id].tcnt) || ((id == 1) && (address == SIM_TCNT1 + 1))) {
+            g_timers[id].shown = g_timers[id].count;
+            g_simIo[g_info[id].tcnt] = (uint8)g_timers[id].count;
+            if (id == 1) {
+                g_simIo[SIM_TCNT1 + 1] = (uint8)(g_timers[id].count >> 8);
+            }
+        }
+    }
+}
+
+void SIM_timerAdvance(uint64 cycle) {
+    uint8 id;
+
+    for (id = 0; id < SIM_NUM_OF_TIMERS; id++) {
+        SIM_timerAdvanceOne(id, cycle);
+    }
+}
+
+// Cycle of the next flag whose interrupt is enabled
+uint64 SIM_timerNextCycle(void) {
+    uint64 next = SIM_NEVER;
+    uint64 cycle;
+    uint32 prescaler, top, compare, distance;
+    uint8 id, i, flag;
+
+    for (id = 0; id < SIM_NUM_OF_TIMERS; id++) {
+        prescaler = SIM_timerPrescaler(id);
+        if (prescaler == 0) {
+            continue;
+        }
+        SIM_timerShape(id, &top, &compare);
+        if (g_timers[id].count > top) {
+            top = g_info[id].max;
+        }
+        for (i = 0; i < 2; i++) {
+            flag = (i == 0) ? g_info[id].compare_flag : g_info[id].overflow_flag;
+            if (((g_simIo[SIM_TIMSK] >> flag) & 1) == 0) {
+                continue;
+            }
+            distance = SIM_timerTicksToFlag(id, g_timers[id].count, top, compare, flag);
+            if (distance) {
+                cycle = g_timers[id].last + (uint64)distance * prescaler;
+                if (cycle < next) {
+                    next = cycle;
+                }
+            }
+        }
+    }
+    return next;
+}
+
+boolean SIM_timerPending(uint8 flag) {
+    return (g_tifr >> flag) & 1;
+}
+
+void SIM_timerAcknowledge(uint8 flag) {
+    g_tifr &= (uint8)~(1 << flag);
+}
@@ -0,0 +1,371 @@
+/******************************************************************************
+ *
+ * Module: SIM
+ *
+ * File Name: sim_uart.c
+ *
+ * Description: Simulated USART and the serial line to the Control ECU
+ *
+ * Author: Doaa Said
+ *
+ *******************************************************************************/
+
+#include "sim.h"
+#include "../MCAL_Drivers/GPIO.h"
+#include "../MCAL_Drivers/UART.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// UCSRA flags owned by the simulated USART
+#define SIM_RXC   0x80
+#define SIM_TXC   0x40
+#define SIM_UDRE  0x20
+#define SIM_FE    0x10
+#define SIM_DOR   0x08
+#define SIM_PE    0x04
+#define SIM_UCSRA_FLAGS (SIM_RXC | SIM_TXC | SIM_UDRE | SIM_FE | SIM_DOR | SIM_PE)
+#define SIM_U2X   0x02
+#define SIM_MPCM  0x01
+
+// UCSRB bits
+#define SIM_TXEN  0x08
+#define SIM_RXEN  0x10
+#define SIM_UCSZ2 0x04
+#define SIM_RXB8  0x02
+
+// Marks the UDR cell as not written, see UDR_REG in UART.h
+#define SIM_UDR_UNWRITTEN 0xFF00
+
+// Bytes sent by the peer, not yet fully received
+#define SIM_LINE_SIZE 256
+
+typedef struct {
+    uint64 cycle;   // End of the stop bit
+    uint8 data;
+    uint8 errors;   // FE/DOR/PE flags of this byte
+    boolean address; // Ninth bit set: address frame of a multi-drop bus
+} SIM_LineByteType;
+
+void (*g_simUartPeer)(uint8 data, boolean frame_error) = NULL_PTR;
+void (*g_simUartMonitor)(boolean transmit, uint8 data) = NULL_PTR;
+
+static uint16 g_udrCell = SIM_UDR_UNWRITTEN;
+static uint8 g_flags = SIM_UDRE;
+static uint8 g_ucsrc = 0x86; // Reset value: 8-bit frames
+static uint8 g_ubrrh = 0;
+
+// Two-level receive buffer of the USART
+static uint8 g_rxData[2];
+static uint8 g_rxErrors[2];
+static boolean g_rxAddress[2];
+static uint8 g_rxCount = 0;
+static boolean g_overrun = FALSE;
+
+// Transmit buffer (UDR) and shift register
+static uint8 g_txData;
+static boolean g_txFull = FALSE;
+static uint8 g_txShift;
+static boolean g_txShifting = FALSE;
+
+static SIM_LineByteType g_line[SIM_LINE_SIZE];
+static uint16 g_lineHead = 0;
+static uint16 g_lineTail = 0;
+static uint64 g_lineFree = 0; // Cycle the line is free for the next peer byte
+
+// The peer pauses between two bytes while the HMI drives RTS high
+static boolean g_lineHeld = FALSE;
+static uint64 g_lineHeldSince;
+static uint32 g_holds = 0;
+
+static uint32 g_peerBaud = 0; // 0: the peer follows the HMI baud rate
+static uint32 g_sent = 0;
+static uint32 g_received = 0;
+
+/*******************************************************************************
+ *                      Private Functions                                      *
+ *******************************************************************************/
+
+// Cycles per bit from UBRR and U2X
+static uint32 SIM_uartBitCycles(void) {
+    uint32 ubrr = g_simIo[SIM_UBRRL] | ((uint32)(g_ubrrh & 0x0F) << 8);
+
+    return (ubrr + 1) * ((g_simIo[SIM_UCSRA] & SIM_U2X) ? 8 : 16);
+}
+
+// Start bit, data bits, parity and stop bits of the current frame format
+static uint8 SIM_uartFrameBits(void) {
+    uint8 size = (uint8)(((g_ucsrc >> 1) & 0x03) | ((g_simIo[SIM_UCSRB] & SIM_UCSZ2) ? 4 : 0));
+    uint8 bits = 1 + ((size == 7) ? 9 : (5 + (size & 0x03)));
+
+    bits += ((g_ucsrc >> 4) & 0x03) ? 1 : 0;
+    bits += (g_ucsrc & 0x08) ? 2 : 1;
+    return bits;
+}
+
+static uint64 SIM_uartFrameCycles(void) {
+    return (uint64)SIM_uartFrameBits() * SIM_uartBitCycles();
+}
+
+// HMI baud rate over the peer's, 1 if the peer follows the HMI
+static double SIM_uartPeerRatio(void) {
+    return g_peerBaud ? ((double)F_CPU / SIM_uartBitCycles()) / g_peerBaud : 1.0;
+}
+
+// More than 4.5% apart: framing errors and garbage, as on the real link
+static boolean SIM_uartPeerMismatch(double ratio) {
+    return (ratio < 0.955) || (ratio > 1.045);
+}
+
+// UCSRA error flags and RXB8 follow the byte at the head of the receive buffer
+static void SIM_uartUpdateRxFlags(void) {
+    g_flags &= (uint8)~(SIM_RXC | SIM_FE | SIM_DOR | SIM_PE);
+    g_simIo[SIM_UCSRB] &= (uint8)~SIM_RXB8;
+    if (g_rxCount) {
+        g_flags |= (uint8)(SIM_RXC | g_rxErrors[0]);
+        if (g_rxAddress[0]) {
+            g_simIo[SIM_UCSRB] |= SIM_RXB8;
+        }
+    }
+}
+
+static void SIM_uartTxDone(uint32 arg) {
+    double ratio = SIM_uartPeerRatio();
+
+    g_sent++;
+    if (g_simUartMonitor != NULL_PTR) {
+        g_simUartMonitor(TRUE, g_txShift);
+    }
+    if (g_simUartPeer != NULL_PTR) {
+        if (SIM_uartPeerMismatch(ratio)) {
+            g_simUartPeer((uint8)(g_txShift / ratio), TRUE);
+        } else {
+            g_simUartPeer(g_txShift, FALSE);
+        }
+    }
+    if (g_txFull) {
+        g_txShift = g_txData; // Next byte moves to the shift register at once
+        g_txFull = FALSE;
+        g_flags |= SIM_UDRE;
+        SIM_schedule(SIM_now() + SIM_uartFrameCycles(), SIM_uartTxDone, 0);
+    } else {
+        g_txShifting = FALSE;
+        g_flags |= SIM_TXC;
+    }
+}
+
+static void SIM_uartTransmit(uint8 data) {
+    if ((g_simIo[SIM_UCSRB] & SIM_TXEN) == 0) {
+        return;
+    }
+    if (!g_txShifting) {
+        g_txShift = data;
+        g_txShifting = TRUE;
+        SIM_schedule(SIM_now() + SIM_uartFrameCycles(), SIM_uartTxDone, 0);
+    } else {
+        g_txData = data; // Overwrites the buffer if UDRE was not checked
+        g_txFull = TRUE;
+        g_flags &= (uint8)~SIM_UDRE;
+    }
+}
+
+// RTS of the HMI (UART_FLOW_CONTROL), only while its pin is an output driven high
+static boolean SIM_uartRtsStopped(void) {
+    uint8 bit = (uint8)(1 << UART_RTS_PIN_ID);
+
+    return (g_simIo[SIM_DDR(UART_RTS_PORT_ID)] & bit) && (g_simIo[SIM_PORT(UART_RTS_PORT_ID)] & bit);
+}
+
+// Hold the next peer byte, due to start at the given cycle, until RTS is low again
+static void SIM_uartHold(uint64 start) {
+    g_lineHeld = TRUE;
+    g_lineHeldSince = (start > SIM_now()) ? start : SIM_now();
+    g_holds++;
+}
+
+static void SIM_uartRxArrive(uint32 arg);
+
+// RTS low again: the held bytes go on, as late as the hold lasted
+static void SIM_uartRelease(void) {
+    uint64 shift = (SIM_now() > g_lineHeldSince) ? (SIM_now() - g_lineHeldSince) : 0;
+    uint16 i;
+
+    g_lineHeld = FALSE;
+    for (i = g_lineTail; i != g_lineHead; i = (i + 1) % SIM_LINE_SIZE) {
+        g_line[i].cycle += shift;
+    }
+    g_lineFree += shift;
+    if (g_lineTail != g_lineHead) {
+        SIM_schedule(g_line[g_lineTail].cycle, SIM_uartRxArrive, 0);
+    }
+}
+
+// A peer byte has been fully received
+static void SIM_uartRxArrive(uint32 arg) {
+    SIM_LineByteType *byte = &g_line[g_lineTail];
+
+    g_lineTail = (g_lineTail + 1) % SIM_LINE_SIZE;
+    if (g_simUartMonitor != NULL_PTR) {
+        g_simUartMonitor(FALSE, byte->data);
+    }
+    if ((g_simIo[SIM_UCSRB] & SIM_RXEN)
+            && (byte->address || !(g_simIo[SIM_UCSRA] & SIM_MPCM))) { // MPCM: data frames are ignored
+        if (g_rxCount == 2) {
+            g_overrun = TRUE; // Lost in the shift register
+        } else {
+            g_rxData[g_rxCount] = byte->data;
+            g_rxErrors[g_rxCount] = byte->errors | (g_overrun ? SIM_DOR : 0);
+            g_rxAddress[g_rxCount] = byte->address;
+            g_overrun = FALSE;
+            g_rxCount++;
+            g_received++;
+        }
+        SIM_uartUpdateRxFlags();
+    }
+    if (g_lineTail != g_lineHead) {
+        if (SIM_uartRtsStopped()) {
+            SIM_uartHold(SIM_now()); // The next byte would start now
+        } else {
+            SIM_schedule(g_line[g_lineTail].cycle, SIM_uartRxArrive, 0);
+        }
+    }
+}
+
+/*******************************************************************************
+ *                      Functions Definitions                                  *
+ *******************************************************************************/
+
+void SIM_uartSync(uint16 address) {
+    uint8 value;
+
+    switch (address) {
+    case SIM_UDR:
+        if ((g_udrCell & SIM_UDR_UNWRITTEN) != SIM_UDR_UNWRITTEN) {
+            SIM_uartTransmit((uint8)g_udrCell);
+        } else if (g_rxCount) {
+            // Read: drop the head of the receive buffer
+            g_rxData[0] = g_rxData[1];
+            g_rxErrors[0] = g_rxErrors[1];
+            g_rxAddress[0] = g_rxAddress[1];
+            g_rxCount--;
+            SIM_uartUpdateRxFlags();
+        }
+        break;
+    case SIM_UBRRH_UCSRC:
+        value = g_simIo[SIM_UBRRH_UCSRC];
+        if (value & 0x80) {
+            g_ucsrc = value; // URSEL selects UCSRC
+        } else {
+            g_ubrrh = value;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Bring UCSRA and UDR up to date and return the register the firmware accesses
+volatile uint8 *SIM_uartRefresh(uint16 address) {
+    if (address == SIM_UCSRA) {
+        // U2X and MPCM keep the firmware's value (clearing TXC by writing one is not simulated)
+        g_simIo[SIM_UCSRA] = (uint8)((g_simIo[SIM_UCSRA] & ~SIM_UCSRA_FLAGS) | g_flags);
+    } else if (address == SIM_UDR) {
+        g_udrCell = SIM_UDR_UNWRITTEN | (g_rxCount ? g_rxData[0] : 0);
+        return (volatile uint8 *)&g_udrCell;
+    }
+    return &g_simIo[address];
+}
+
+// GPIO write: the peer goes on if RTS is low again
+void SIM_uartPinSync(void) {
+    if (g_lineHeld && !SIM_uartRtsStopped()) {
+        SIM_uartRelease();
+    }
+}
+
+// The peer is always ready to take bytes: it drives CTS low
+void SIM_uartDrive(uint8 port, uint8 *level) {
+    if (port == UART_CTS_PORT_ID) {
+        *level &= (uint8)~(1 << UART_CTS_PIN_ID);
+    }
+}
+
+boolean SIM_uartRxPending(void) {
+    return (g_flags & SIM_RXC) != 0;
+}
+
+boolean SIM_uartUdrePending(void) {
+    return (g_flags & SIM_UDRE) != 0;
+}
+
+boolean SIM_uartTxPending(void) {
+    return (g_flags & SIM_TXC) != 0;
+}
+
+void SIM_uartTxAcknowledge(void) {
+    g_flags &= (uint8)~SIM_TXC; // TXC is cleared when its vector is taken
+}
+
+/*
+ * Queue bytes from the peer on the line, back to back, starting delay cycles
+ * from now. A peer baud rate more than 4.5% away from the HMI's gives framing
+ * errors and garbage.
+ */
+static void SIM_uartQueue(const uint8 *data, uint8 length, uint64 delay, boolean address) {
+    double ratio = SIM_uartPeerRatio();
+    uint64 frame = (uint64)((double)SIM_uartFrameCycles() * ratio);
+    uint64 start = SIM_now() + delay;
+    uint8 i;
+
+    if (start < g_lineFree) {
+        start = g_lineFree;
+    }
+    for (i = 0; i < length; i++) {
+        if (((g_lineHead + 1) % SIM_LINE_SIZE) == g_lineTail) {
+            fprintf(stderr, "sim: UART line overflow\n");
+            SIM_stop(EXIT_FAILURE);
+        }
+        start += frame;
+        g_line[g_lineHead].cycle = start;
+        g_line[g_lineHead].data = data[i];
+        g_line[g_lineHead].errors = 0;
+        g_line[g_lineHead].address = address;
+        if (SIM_uartPeerMismatch(ratio)) {
+            g_line[g_lineHead].data = (uint8)(data[i] * ratio);
+            g_line[g_lineHead].errors = SIM_FE;
+        }
+        if ((g_lineHead == g_lineTail) && !g_lineHeld) {
+            if (SIM_uartRtsStopped()) {
+                SIM_uartHold(start - frame);
+            } else {
+                SIM_schedule(start, SIM_uartRxArrive, 0);
+            }
+        }
+        g_lineHead = (g_lineHead + 1) % SIM_LINE_SIZE;
+    }
+    g_lineFree = start;
+}
+
+void SIM_uartPeerSend(const uint8 *data, uint8 length, uint64 delay) {
+    SIM_uartQueue(data, length, delay, FALSE);
+}
+
+// Address frame of a multi-drop bus (9-bit frames, ninth bit set)
+void SIM_uartPeerSendAddress(uint8 address, uint64 delay) {
+    SIM_uartQueue(&address, 1, delay, TRUE);
+}
+
+void SIM_uartSetPeerBaud(uint32 baud) {
+    g_peerBaud = baud;
+}
+
+uint32 SIM_uartBytesSent(void) {
+    return g_sent;
+}
+
+uint32 SIM_uartBytesReceived(void) {
+    return g_received;
+}
+
+uint32 SIM_uartHolds(void) {
+    return g_holds;
+}